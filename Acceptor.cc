@@ -6,6 +6,7 @@
 #include <sys/socket.h>
 #include <error.h>
 #include <unistd.h>
+#include <fcntl.h>
 
 static int createNonblocking()
 {
@@ -14,6 +15,29 @@ static int createNonblocking()
     {
         LOG_FATAL("%s:%s:%d listen socket create err:%d \n", __FILE__, __FUNCTION__, __LINE__, errno);
     }
+    return socketfd;
+}
+
+static int openIdleFd()
+{
+    int fd = ::open("/dev/null", O_RDONLY | O_CLOEXEC);
+    if (fd < 0)
+    {
+        LOG_ERROR("%s:%s:%d open /dev/null err:%d \n", __FILE__, __FUNCTION__, __LINE__, errno);
+    }
+    return fd;
+}
+
+const int Acceptor::kDefaultAcceptBatch;
+
+static int dupListenSocket(int fd)
+{
+    int newfd = ::fcntl(fd, F_DUPFD_CLOEXEC, 0);
+    if (newfd < 0)
+    {
+        LOG_FATAL("%s:%s:%d listen socket dup err:%d \n", __FILE__, __FUNCTION__, __LINE__, errno);
+    }
+    return newfd;
 }
 
 Acceptor::Acceptor(EventLoop *loop, const InetAddress &listenAddr, bool reuseport)
@@ -21,17 +45,44 @@ Acceptor::Acceptor(EventLoop *loop, const InetAddress &listenAddr, bool reusepor
     , acceptSocket_(createNonblocking())  // socket
     , acceptChannel_(loop, acceptSocket_.fd())  // channel依赖loop的原因，channel需要往poller上注册修改，channel无法直接与poller通信，而loop下面管理了一系列的channel和poller
     , listenning_(false)
+    , acceptBatch_(kDefaultAcceptBatch)
+    , idleFd_(openIdleFd())
+    , numAccepted_(0)
+    , numDropped_(0)
+    , totalAccepted_(nullptr)
+    , totalDropped_(nullptr)
 {
     acceptSocket_.setReuseAddr(true);
-    acceptSocket_.setReusePort(true);
+    acceptSocket_.setReusePort(reuseport);
     acceptSocket_.bindAddress(listenAddr);  // bind
     // TcpServer::start() ==> Acceptor.listen() 如果有新用户连接，要执行一个回调(将connfd打包成channel,然后唤醒一个subloop并把channel给它)
     acceptChannel_.setReadCallback(std::bind(&Acceptor::handleRead, this));
 }
+
+// dup出来的fd和原来的fd指向同一个监听socket，已经bind过了，listen只是再设置一遍backlog
+Acceptor::Acceptor(EventLoop *loop, const Acceptor &shared)
+    : loop_(loop)
+    , acceptSocket_(dupListenSocket(shared.acceptSocket_.fd()))
+    , acceptChannel_(loop, acceptSocket_.fd())
+    , listenning_(false)
+    , acceptBatch_(shared.acceptBatch_)
+    , idleFd_(openIdleFd())
+    , numAccepted_(0)
+    , numDropped_(0)
+    , totalAccepted_(nullptr)
+    , totalDropped_(nullptr)
+{
+    acceptChannel_.setExclusive(true);
+    acceptChannel_.setReadCallback(std::bind(&Acceptor::handleRead, this));
+}
 Acceptor::~Acceptor()
 {
     acceptChannel_.disableAll();
     acceptChannel_.remove();
+    if (idleFd_ >= 0)
+    {
+        ::close(idleFd_);
+    }
 }
 
 void Acceptor::listen()
@@ -41,28 +92,74 @@ void Acceptor::listen()
     acceptChannel_.enableReading();  // acceptChannel_ => Poller
 }
 
-// listenfd有事件发生，就是有新用户连接了
+// listenfd有事件发生，就是有新用户连接了，一次最多取acceptBatch_个
 void Acceptor::handleRead()
 {
-    InetAddress peerAddr;
-    int connfd = acceptSocket_.accept(&peerAddr);
-    if (connfd >= 0)
+    for (int i = 0; i < acceptBatch_; ++i)
     {
-        if (newConnectionCallback_)
+        InetAddress peerAddr;
+        int connfd = acceptSocket_.accept(&peerAddr);
+        if (connfd >= 0)
+        {
+            numAccepted_.store(numAccepted_.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+            if (totalAccepted_)
+            {
+                totalAccepted_->fetch_add(1, std::memory_order_relaxed); // 别的loop上的Acceptor也在加
+            }
+            if (newConnectionCallback_)
+            {
+                newConnectionCallback_(connfd, peerAddr);
+            }
+            else
+            {
+                ::close(connfd);
+            }
+            continue;
+        }
+
+        int savedErrno = errno;
+        if (savedErrno == EAGAIN || savedErrno == EWOULDBLOCK)
+        {
+            break; // backlog取空了；多个loop共享监听socket时也可能被别的loop抢先accept了
+        }
+        else if (savedErrno == EINTR || savedErrno == ECONNABORTED)
+        {
+            continue; // 对端在accept之前就断开了
+        }
+        else if (savedErrno == EMFILE || savedErrno == ENFILE)
         {
-            newConnectionCallback_(connfd, peerAddr);
+            LOG_ERROR("%s:%s:%d sockfd reached limit! \n", __FILE__, __FUNCTION__, __LINE__);
+            if (!dropPending())
+            {
+                break;
+            }
         }
         else
         {
-            ::close(connfd);
+            LOG_ERROR("%s:%s:%d accept err:%d \n", __FILE__, __FUNCTION__, __LINE__, savedErrno);
+            break;
         }
     }
-    else
+}
+
+bool Acceptor::dropPending()
+{
+    if (idleFd_ < 0)
+    {
+        return false; // 预留的fd也没有拿到，只能等别的连接释放fd
+    }
+    ::close(idleFd_);
+    int connfd = ::accept(acceptSocket_.fd(), nullptr, nullptr);
+    bool dropped = connfd >= 0;
+    if (dropped)
     {
-        LOG_ERROR("%s:%s:%d accept err:%d \n", __FILE__, __FUNCTION__, __LINE__, errno);
-        if (errno == EMFILE)
+        ::close(connfd); // 对端收到FIN，而不是一直等在backlog里直到超时
+        numDropped_.store(numDropped_.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+        if (totalDropped_)
         {
-            LOG_ERROR("%s:%s:%d sockfd reached limit! \n", __FILE__, __FUNCTION__, __LINE__);
+            totalDropped_->fetch_add(1, std::memory_order_relaxed);
         }
     }
+    idleFd_ = openIdleFd();
+    return dropped;
 }
\ No newline at end of file
@@ -4,6 +4,7 @@
 #include "Channel.h"
 
 #include <functional>
+#include <atomic>
 
 class EventLoop;
 class InetAddress;
@@ -13,6 +14,9 @@ class Acceptor : noncopyable
 public:
     using NewConnectionCallback = std::function<void(int sockfd, const InetAddress&)>;
     Acceptor(EventLoop *loop, const InetAddress &listenAddr, bool reuseport);
+    // 和shared共享同一个监听socket(dup出来的fd)，在loop上用EPOLLEXCLUSIVE监听，
+    // 多个loop同时等待时一个新连接只唤醒其中一个
+    Acceptor(EventLoop *loop, const Acceptor &shared);
     ~Acceptor();
 
     void setNewConnectionCallback(const NewConnectionCallback &cb)
@@ -20,14 +24,43 @@ public:
         newConnectionCallback_ = cb;
     }
 
+    // 用EPOLLEXCLUSIVE注册监听socket，需要在listen之前设置
+    void setExclusive(bool on) { acceptChannel_.setExclusive(on); }
+
+    // 每次可读事件最多accept多少个连接，连接风暴时不用每个连接都回一趟epoll_wait
+    void setAcceptBatch(int batch) { acceptBatch_ = batch > 0 ? batch : 1; }
+    static const int kDefaultAcceptBatch = 16;
+
+    // 累计accept的连接数 / fd用完时直接关闭掉的连接数，可以在任意线程读，两次采样相减就是速率
+    uint64_t numAccepted() const { return numAccepted_.load(std::memory_order_relaxed); }
+    uint64_t numDropped() const { return numDropped_.load(std::memory_order_relaxed); }
+    // 计数的同时累加到外面的总数上，几个Acceptor共用一份总数(TcpServer)，Acceptor析构以后总数仍然有效
+    void setTotals(std::atomic<uint64_t> *accepted, std::atomic<uint64_t> *dropped)
+    {
+        totalAccepted_ = accepted;
+        totalDropped_ = dropped;
+    }
+
+    EventLoop* getLoop() const { return loop_; }
     bool listenning() const { return listenning_; }
+    // 需要在loop所在的线程里调用
     void listen();
 private:
     void handleRead();
+    // fd用完(EMFILE/ENFILE)时，用预留的fd把积压的连接accept下来马上关掉，返回是否关掉了一个
+    bool dropPending();
     
     EventLoop *loop_; // Acceptor用的就是用户定义的那个baseloop，也称作mainloop
     Socket acceptSocket_; 
     Channel acceptChannel_;
     NewConnectionCallback newConnectionCallback_; // 来了一个新连接的回调，把fd打包成channel，通过getNextLoop唤醒一个subLoop, 再把channel分发给相应的loop去监听已连接用户的读写事件
     bool listenning_;
+    int acceptBatch_;
+    // 预留的/dev/null，fd用完的时候腾出来接一个连接再关掉，
+    // 否则连接一直留在backlog里，水平触发的监听fd会让loop一直空转
+    int idleFd_;
+    std::atomic<uint64_t> numAccepted_;
+    std::atomic<uint64_t> numDropped_;
+    std::atomic<uint64_t> *totalAccepted_;
+    std::atomic<uint64_t> *totalDropped_;
 };
\ No newline at end of file
@@ -1,16 +1,153 @@
 #include "Buffer.h"
+#include "BufferPool.h"
 
 #include <errno.h>
+#include <string.h>
 #include <sys/uio.h>
 #include <unistd.h>
+#include <memory>
+
+const size_t Buffer::kCheapPrepend;
+const size_t Buffer::kInitialSize;
+const size_t Buffer::kExtraBufSize;
+const size_t Buffer::kMinReadHint;
+const size_t Buffer::kMaxReadHint;
+char Buffer::emptyStorage_[Buffer::kCheapPrepend];
+
+namespace
+{
+    __thread uint64_t t_reads = 0;
+    __thread uint64_t t_bytesRead = 0;
+    __thread uint64_t t_bytesSpilled = 0;
+    __thread uint64_t t_bytesCopied = 0;
+
+    // readFd的暂存区，每个线程(也就是每个EventLoop)一块，这个线程上的所有连接共用
+    // 不初始化，只在第一次用到时分配
+    char* readScratch()
+    {
+        thread_local std::unique_ptr<char[]> scratch(new char[Buffer::kExtraBufSize]);
+        return scratch.get();
+    }
+}
+
+Buffer::Buffer(const Buffer &rhs)
+    : buffer_(nullptr)
+    , capacity_(0)
+    , initialSize_(rhs.initialSize_)
+    , readerIndex_(kCheapPrepend)
+    , writerIndex_(kCheapPrepend)
+    , readHint_(kMinReadHint)
+    , readPeak_(0)
+{
+    append(rhs.peek(), rhs.readableBytes());
+}
+
+Buffer& Buffer::operator=(const Buffer &rhs)
+{
+    if (this != &rhs)
+    {
+        Buffer copy(rhs);
+        swap(copy);
+    }
+    return *this;
+}
+
+void Buffer::reallocate(size_t newCapacity, size_t prependSize)
+{
+    newCapacity = BufferPool::roundUp(newCapacity);
+    char *storage = static_cast<char*>(BufferPool::allocate(newCapacity));
+    size_t readable = readableBytes();
+    ::memcpy(storage + prependSize, peek(), readable);
+    t_bytesCopied += readable;
+    releaseStorage();
+    buffer_ = storage;
+    capacity_ = newCapacity;
+    readerIndex_ = prependSize;
+    writerIndex_ = readerIndex_ + readable;
+}
+
+void Buffer::prepend(const void *data, size_t len)
+{
+    // 没有存储时prependableBytes()的kCheapPrepend字节指向共享的emptyStorage_，不能写
+    if (buffer_ == nullptr || len > prependableBytes())
+    {
+        size_t prependSize = std::max(len, kCheapPrepend);
+        reallocate(std::max(prependSize + readableBytes(), initialSize_), prependSize);
+    }
+    readerIndex_ -= len;
+    ::memcpy(begin() + readerIndex_, data, len);
+}
+
+void Buffer::makeSpace(size_t len)
+{
+    if (writableBytes() + prependableBytes() < len + kCheapPrepend)
+    {
+        // 第一次至少initialSize_，之后至少翻倍，连续的小追加不会每次都换存储
+        size_t needed = std::max(kCheapPrepend + readableBytes() + len, initialSize_);
+        reallocate(std::max(needed, capacity_ * 2));
+    }
+    else
+    {
+        size_t readable = readableBytes();
+        ::memmove(begin() + kCheapPrepend, peek(), readable);
+        t_bytesCopied += readable;
+        readerIndex_ = kCheapPrepend;
+        writerIndex_ = readerIndex_ + readable;
+    }
+}
+
+void Buffer::releaseStorage()
+{
+    if (buffer_ != nullptr)
+    {
+        BufferPool::deallocate(buffer_, capacity_);
+        buffer_ = nullptr;
+        capacity_ = 0;
+    }
+}
+
+void Buffer::shrinkToFit()
+{
+    size_t readable = readableBytes();
+    if (readable == 0)
+    {
+        // 不管readHint_多大都还回去，空闲的连接不留大块存储
+        readerIndex_ = writerIndex_ = kCheapPrepend;
+        releaseStorage();
+        return;
+    }
+    size_t fit = BufferPool::roundUp(kCheapPrepend + readable);
+    if (fit < capacity_)
+    {
+        reallocate(fit);
+    }
+}
+
 /**
  * 从fd上读取数据  poller默认工作在LT模式
  * Buffer缓冲区是有大小的，但是从fd上读数据的时候，却不知道tcp数据最终的大小
- * 解决方案：开辟一个栈空间来暂存放不下的数据
+ * 解决方案：先按readHint_预留可写空间，放不下的数据读到线程局部的暂存区，再追加进来
  */
 ssize_t Buffer::readFd(int fd, int* saveErrno)
 {
-    char extrabuf[65536] = {0}; // 栈上的内存空间 64k
+    char *extrabuf = readScratch();
+
+    // readHint_是这个连接的缓冲区最近要攒下的数据量，连续收大消息的连接按它预留，直接读进存储
+    // 缓冲区空了说明上一轮攒的数据都处理完了，上一轮最多只用到预留的1/4时预留减1/8，
+    // 每次只减一点，流量有起伏的连接不会刚缩下去又要扩
+    size_t readable = readableBytes();
+    if (readable == 0)
+    {
+        if (readPeak_ < readHint_ / 4)
+        {
+            readHint_ = std::max(readHint_ - readHint_ / 8, kMinReadHint);
+        }
+        readPeak_ = 0;
+    }
+
+    // 空闲的时候不占存储，真正读的时候才从内存池拿，放不下的部分先读到extrabuf
+    // 还有较多没处理完的数据时，预留要先把它们挪走，不比读进extrabuf再追加省，只保证最少的kMinReadHint
+    ensureWriteableBytes(readable < kMinReadHint ? readHint_ : kMinReadHint);
 
     struct iovec vec[2];
 
@@ -19,11 +156,11 @@ ssize_t Buffer::readFd(int fd, int* saveErrno)
     vec[0].iov_len = writable;
 
     vec[1].iov_base = extrabuf;
-    vec[1].iov_len = sizeof extrabuf;
+    vec[1].iov_len = kExtraBufSize;
 
-    // 如果可写缓冲区的大小小于64k，则总缓冲区为可写缓冲区+栈缓冲区；
+    // 如果可写缓冲区的大小小于64k，则总缓冲区为可写缓冲区+暂存区；
     // 如果可写缓冲区的大小大于64k，则总缓冲区为可写缓冲区；
-    const int iovcnt = (writable < sizeof extrabuf) ? 2 : 1; 
+    const int iovcnt = (writable < kExtraBufSize) ? 2 : 1;
     const ssize_t n = ::readv(fd, vec, iovcnt);
     if (n < 0)
     {
@@ -35,13 +172,70 @@ ssize_t Buffer::readFd(int fd, int* saveErrno)
     }
     else // extrabuf里面也写入了数据
     {
-        writerIndex_ = buffer_.size();
+        writerIndex_ = capacity_;
         append(extrabuf, n - writable); // writerIndex_开始写 n-writable大小的数据
+        t_bytesSpilled += n - writable;
+        t_bytesCopied += n - writable;
+    }
+    if (n > 0)
+    {
+        ++t_reads;
+        t_bytesRead += n;
+        readPeak_ = std::max(readPeak_, readableBytes());
+        if (static_cast<size_t>(n) >= writable)
+        {
+            // 预留的空间被读满了，这个连接要攒的数据比预留的多，下次至少翻倍
+            readHint_ = std::min(std::max(readHint_ * 2, readableBytes()), kMaxReadHint);
+        }
+    }
+    if (readableBytes() == 0)
+    {
+        retrieveAll(); // 没读到数据，刚拿的存储还回去
     }
 
     return n;
 }
 
+const char* Buffer::findCRLF(const char *start) const
+{
+    // 先用memchr找'\r'，再看下一个字节是不是'\n'，比逐字节比较两个字符快
+    const char *end = beginWrite();
+    while (start < end)
+    {
+        const char *cr = static_cast<const char*>(::memchr(start, '\r', end - start));
+        if (cr == nullptr || cr + 1 == end)
+        {
+            return nullptr;
+        }
+        if (cr[1] == '\n')
+        {
+            return cr;
+        }
+        start = cr + 1;
+    }
+    return nullptr;
+}
+
+const char* Buffer::findEOL(const char *start) const
+{
+    const char *end = beginWrite();
+    if (start >= end)
+    {
+        return nullptr;
+    }
+    return static_cast<const char*>(::memchr(start, '\n', end - start));
+}
+
+Buffer::Stats Buffer::stats()
+{
+    Stats stats;
+    stats.reads = t_reads;
+    stats.bytesRead = t_bytesRead;
+    stats.bytesSpilled = t_bytesSpilled;
+    stats.bytesCopied = t_bytesCopied;
+    return stats;
+}
+
 ssize_t Buffer::writeFd(int fd, int* saveErrno)
 {
     ssize_t n = ::write(fd, peek(), readableBytes());
@@ -1,21 +1,59 @@
-#pragma once 
+#pragma once
 
 #include <vector>
 #include <string>
 #include <algorithm>
+#include <stdint.h>
+#include <string.h>
+#include <endian.h>
+#include <sys/types.h>
+
+#include "StringPiece.h"
+#include "BufferPool.h"
 
 // 网络库底层的缓冲区类型定义
+// 存储从当前线程的BufferPool里按大小级别取，第一次写入时才分配，数据读完(retrieveAll)就还回去，
+// 大量空闲连接的缓冲区不占内存；只有readFd预留超过池最大级别的连续收大消息的连接，读完以后留着存储
+// readFd按这个缓冲区最近攒下的数据量预留空间，连续读大消息的连接直接读进自己的存储，不经过暂存区再拷一遍
+//
+// +-------------------+------------------+------------------+
+// | prependable bytes |  readable bytes  |  writable bytes  |
+// +-------------------+------------------+------------------+
+// 0      <=      readerIndex   <=   writerIndex    <=     capacity
+// 整数都按网络字节序(大端)读写；prepend往可读数据前面加数据，消息体写完以后再补长度头，不用先拼一个字符串
 class Buffer
 {
 public:
     static const size_t kCheapPrepend = 8;    // 用来记录数据包的长度
-    static const size_t kInitialSize = 1024;  // 用来记录缓冲区的初始化的大小
+    static const size_t kInitialSize = 1024;  // 第一次分配的存储的最小大小(包括kCheapPrepend)
+    static const size_t kExtraBufSize = 65536;     // readFd放不下时用的线程局部暂存区大小
+    static const size_t kMinReadHint = 512;        // readFd至少预留的可写空间
+    static const size_t kMaxReadHint = 1024 * 1024; // readFd最多预留的空间
 
     explicit Buffer(size_t initialSize = kInitialSize)
-        : buffer_(kCheapPrepend + initialSize)
+        : buffer_(nullptr)
+        , capacity_(0)
+        , initialSize_(initialSize)
         , readerIndex_(kCheapPrepend)
         , writerIndex_(kCheapPrepend)
+        , readHint_(kMinReadHint)
+        , readPeak_(0)
     {}
+    ~Buffer() { releaseStorage(); }
+
+    Buffer(const Buffer &rhs);
+    Buffer& operator=(const Buffer &rhs);
+
+    void swap(Buffer &rhs)
+    {
+        std::swap(buffer_, rhs.buffer_);
+        std::swap(capacity_, rhs.capacity_);
+        std::swap(initialSize_, rhs.initialSize_);
+        std::swap(readerIndex_, rhs.readerIndex_);
+        std::swap(writerIndex_, rhs.writerIndex_);
+        std::swap(readHint_, rhs.readHint_);
+        std::swap(readPeak_, rhs.readPeak_);
+    }
 
     size_t readableBytes() const
     {
@@ -24,7 +62,7 @@ public:
 
     size_t writableBytes() const
     {
-        return buffer_.size() - writerIndex_;
+        return capacity_ > writerIndex_ ? capacity_ - writerIndex_ : 0;
     }
 
     size_t prependableBytes() const
@@ -32,12 +70,39 @@ public:
         return readerIndex_;
     }
 
+    // 当前占用的存储大小，没有分配时是0
+    size_t capacity() const
+    {
+        return capacity_;
+    }
+
     // 返回缓冲区中可读数据的起始地址
     const char* peek() const
     {
         return begin() + readerIndex_;
     }
 
+    // 可读数据的视图，不拷贝，下一次retrieve/append之前有效
+    StringPiece peekView() const
+    {
+        return StringPiece(peek(), readableBytes());
+    }
+
+    // 在可读数据里找"\r\n"，返回指向'\r'的指针，没有时返回nullptr
+    // start必须在[peek(), beginWrite()]之间，用来跳过上次已经找过的部分
+    const char* findCRLF() const
+    {
+        return findCRLF(peek());
+    }
+    const char* findCRLF(const char *start) const;
+
+    // 在可读数据里找'\n'，返回指向它的指针，没有时返回nullptr
+    const char* findEOL() const
+    {
+        return findEOL(peek());
+    }
+    const char* findEOL(const char *start) const;
+
     // onMessage string <- Buffer
     void retrieve(size_t len)
     {
@@ -51,9 +116,21 @@ public:
         }
     }
 
+    // 取出[peek(), end)的数据，end一般是findCRLF/findEOL的结果加上分隔符的长度
+    void retrieveUntil(const char *end)
+    {
+        retrieve(end - peek());
+    }
+
+    // 数据都读完了，存储还给内存池
+    // readHint_超过池最大级别时存储是operator new来的，下一条消息马上又要这么大，留着不还，等readHint_降下来再还
     void retrieveAll()
     {
-        readerIndex_ = writerIndex_ = kCheapPrepend; 
+        readerIndex_ = writerIndex_ = kCheapPrepend;
+        if (readHint_ + kCheapPrepend <= BufferPool::kMaxClassSize)
+        {
+            releaseStorage();
+        }
     }
 
     // 把onMessage函数上报的Buffer数据，转成string类型的数据返回
@@ -76,7 +153,7 @@ public:
             makeSpace(len); // 扩容函数
         }
     }
-    
+
     // 把[data, data+len]内存上的数据，添加到writable缓冲区当中
     void append(const char *data, size_t len)
     {
@@ -84,7 +161,122 @@ public:
         std::copy(data, data+len, beginWrite());
         writerIndex_ += len;
     }
-    
+
+    void append(const StringPiece &str)
+    {
+        append(str.data(), str.size());
+    }
+
+    void append(const void *data, size_t len)
+    {
+        append(static_cast<const char*>(data), len);
+    }
+
+    void appendInt64(int64_t x)
+    {
+        uint64_t be64 = htobe64(static_cast<uint64_t>(x));
+        append(&be64, sizeof be64);
+    }
+
+    void appendInt32(int32_t x)
+    {
+        uint32_t be32 = htobe32(static_cast<uint32_t>(x));
+        append(&be32, sizeof be32);
+    }
+
+    void appendInt16(int16_t x)
+    {
+        uint16_t be16 = htobe16(static_cast<uint16_t>(x));
+        append(&be16, sizeof be16);
+    }
+
+    void appendInt8(int8_t x)
+    {
+        append(&x, sizeof x);
+    }
+
+    // peekInt*只看不取，readInt*看完以后retrieve，调用前要保证readableBytes()够长
+    int64_t peekInt64() const
+    {
+        uint64_t be64 = 0;
+        ::memcpy(&be64, peek(), sizeof be64);
+        return static_cast<int64_t>(be64toh(be64));
+    }
+
+    int32_t peekInt32() const
+    {
+        uint32_t be32 = 0;
+        ::memcpy(&be32, peek(), sizeof be32);
+        return static_cast<int32_t>(be32toh(be32));
+    }
+
+    int16_t peekInt16() const
+    {
+        uint16_t be16 = 0;
+        ::memcpy(&be16, peek(), sizeof be16);
+        return static_cast<int16_t>(be16toh(be16));
+    }
+
+    int8_t peekInt8() const
+    {
+        return static_cast<int8_t>(*peek());
+    }
+
+    int64_t readInt64()
+    {
+        int64_t result = peekInt64();
+        retrieve(sizeof result);
+        return result;
+    }
+
+    int32_t readInt32()
+    {
+        int32_t result = peekInt32();
+        retrieve(sizeof result);
+        return result;
+    }
+
+    int16_t readInt16()
+    {
+        int16_t result = peekInt16();
+        retrieve(sizeof result);
+        return result;
+    }
+
+    int8_t readInt8()
+    {
+        int8_t result = peekInt8();
+        retrieve(sizeof result);
+        return result;
+    }
+
+    // 把[data, data+len]放到可读数据的前面，kCheapPrepend以内不用挪数据
+    // 还没有存储或者前面的空间不够时换一块存储，在前面留出len字节
+    void prepend(const void *data, size_t len);
+
+    void prependInt64(int64_t x)
+    {
+        uint64_t be64 = htobe64(static_cast<uint64_t>(x));
+        prepend(&be64, sizeof be64);
+    }
+
+    void prependInt32(int32_t x)
+    {
+        uint32_t be32 = htobe32(static_cast<uint32_t>(x));
+        prepend(&be32, sizeof be32);
+    }
+
+    void prependInt16(int16_t x)
+    {
+        uint16_t be16 = htobe16(static_cast<uint16_t>(x));
+        prepend(&be16, sizeof be16);
+    }
+
+    void prependInt8(int8_t x)
+    {
+        prepend(&x, sizeof x);
+    }
+
     char* beginWrite()
     {
         return begin() + writerIndex_;
@@ -94,38 +286,53 @@ public:
     {
         return begin() + writerIndex_;
     }
-    
+
+    // 把存储换成能放下可读数据的最小大小级别，没有数据时直接还给内存池
+    // 用于曾经涨到很大、之后长时间只剩少量数据的缓冲区
+    void shrinkToFit();
+
+    // 下一次readFd预留的可写空间
+    size_t readHint() const
+    {
+        return readHint_;
+    }
+
     // 从fd上读取数据
     ssize_t readFd(int fd, int* saveErrno);
     // 通过fd发送数据
     ssize_t writeFd(int fd, int* saveErrno);
+
+    // 当前线程里所有Buffer的统计，bytesCopied是存储之间搬运数据的字节数：
+    // 从暂存区追加进来的、扩容换存储时拷过去的、往前挪到kCheapPrepend处的
+    struct Stats
+    {
+        uint64_t reads;        // readFd读到数据的次数
+        uint64_t bytesRead;    // readFd读到的字节数
+        uint64_t bytesSpilled; // 其中先读进暂存区、再追加进来的字节数
+        uint64_t bytesCopied;
+    };
+    static Stats stats();
 private:
     char* begin()
     {
-        return &*buffer_.begin(); // vector底层数组首元素的地址，也就是数组的起始地址
+        return buffer_ ? buffer_ : emptyStorage_;
     }
     const char* begin() const
     {
-        return &*buffer_.begin();
-    }
-    void makeSpace(size_t len)
-    {
-        if (writableBytes() + prependableBytes() < len + kCheapPrepend)
-        {
-            buffer_.resize(writerIndex_ + len);
-        }
-        else
-        {
-            size_t readable = readableBytes();
-            std::copy(begin() + readerIndex_,
-                    begin() + writerIndex_,
-                    begin() + kCheapPrepend);
-            readerIndex_ = kCheapPrepend;
-            writerIndex_ = readerIndex_ + readable;
-        }
+        return buffer_ ? buffer_ : emptyStorage_;
     }
-       
-    std::vector<char> buffer_;
+    // 换一块至少newCapacity大小的存储，可读数据搬到prependSize处
+    void reallocate(size_t newCapacity, size_t prependSize = kCheapPrepend);
+    void releaseStorage();
+    void makeSpace(size_t len);
+
+    static char emptyStorage_[kCheapPrepend]; // 没有存储时peek()指向这里，长度为0
+
+    char *buffer_;
+    size_t capacity_;
+    size_t initialSize_;
     size_t readerIndex_;
     size_t writerIndex_;
-};
\ No newline at end of file
+    size_t readHint_;
+    size_t readPeak_; // 上次readFd时缓冲区是空的以来，读完以后攒到的最多的数据量
+};
@@ -0,0 +1,191 @@
+#include "BufferChain.h"
+#include "BufferPool.h"
+
+#include <errno.h>
+#include <string.h>
+#include <algorithm>
+
+const size_t BufferChain::kBlockSize;
+const int BufferChain::kMaxIov;
+const size_t BufferChain::kBlockDataSize;
+
+BufferChain::Block* BufferChain::allocateBlock()
+{
+    static_assert(sizeof(Block) == kBlockSize, "a block must fill one BufferPool size class");
+    Block *block = static_cast<Block*>(BufferPool::allocate(kBlockSize));
+    block->next = nullptr;
+    block->readerIndex = 0;
+    block->writerIndex = 0;
+    ++numBlocks_;
+    return block;
+}
+
+void BufferChain::freeBlock(Block *block)
+{
+    --numBlocks_;
+    BufferPool::deallocate(block, kBlockSize);
+}
+
+BufferChain::BufferChain()
+    : head_(nullptr)
+    , tail_(nullptr)
+    , readableBytes_(0)
+    , numBlocks_(0)
+{
+}
+
+BufferChain::~BufferChain()
+{
+    retrieveAll();
+}
+
+void BufferChain::swap(BufferChain &rhs)
+{
+    std::swap(head_, rhs.head_);
+    std::swap(tail_, rhs.tail_);
+    std::swap(readableBytes_, rhs.readableBytes_);
+    std::swap(numBlocks_, rhs.numBlocks_);
+}
+
+const char* BufferChain::peek() const
+{
+    return head_ ? head_->data + head_->readerIndex : nullptr;
+}
+
+size_t BufferChain::contiguousBytes() const
+{
+    return head_ ? head_->writerIndex - head_->readerIndex : 0;
+}
+
+void BufferChain::retrieve(size_t len)
+{
+    if (len >= readableBytes_)
+    {
+        retrieveAll();
+        return;
+    }
+    readableBytes_ -= len;
+    while (len > 0)
+    {
+        size_t n = std::min<size_t>(len, head_->writerIndex - head_->readerIndex);
+        head_->readerIndex += n;
+        len -= n;
+        if (head_->readerIndex == head_->writerIndex && head_ != tail_)
+        {
+            Block *block = head_;
+            head_ = block->next;
+            freeBlock(block);
+        }
+    }
+}
+
+void BufferChain::retrieveAll()
+{
+    while (head_ != nullptr)
+    {
+        Block *block = head_;
+        head_ = block->next;
+        freeBlock(block);
+    }
+    tail_ = nullptr;
+    readableBytes_ = 0;
+}
+
+std::string BufferChain::retrieveAllAsString()
+{
+    return retrieveAsString(readableBytes_);
+}
+
+std::string BufferChain::retrieveAsString(size_t len)
+{
+    len = std::min<size_t>(len, readableBytes_);
+    std::string result;
+    result.reserve(len);
+    size_t remaining = len;
+    for (Block *block = head_; block != nullptr && remaining > 0; block = block->next)
+    {
+        size_t n = std::min<size_t>(remaining, block->writerIndex - block->readerIndex);
+        result.append(block->data + block->readerIndex, n);
+        remaining -= n;
+    }
+    retrieve(len);
+    return result;
+}
+
+void BufferChain::append(const char *data, size_t len)
+{
+    readableBytes_ += len;
+    while (len > 0)
+    {
+        if (tail_ == nullptr || tail_->writerIndex == kBlockDataSize)
+        {
+            Block *block = allocateBlock();
+            if (tail_ == nullptr)
+            {
+                head_ = block;
+            }
+            else
+            {
+                tail_->next = block;
+            }
+            tail_ = block;
+        }
+        size_t n = std::min<size_t>(len, kBlockDataSize - tail_->writerIndex);
+        ::memcpy(tail_->data + tail_->writerIndex, data, n);
+        tail_->writerIndex += n;
+        data += n;
+        len -= n;
+    }
+}
+
+void BufferChain::splice(BufferChain &rhs)
+{
+    if (rhs.head_ == nullptr)
+    {
+        return;
+    }
+    if (tail_ == nullptr)
+    {
+        head_ = rhs.head_;
+    }
+    else
+    {
+        tail_->next = rhs.head_;
+    }
+    tail_ = rhs.tail_;
+    readableBytes_ += rhs.readableBytes_;
+    numBlocks_ += rhs.numBlocks_;
+    rhs.head_ = nullptr;
+    rhs.tail_ = nullptr;
+    rhs.readableBytes_ = 0;
+    rhs.numBlocks_ = 0;
+}
+
+int BufferChain::fillIovec(struct iovec *iov, int maxIov) const
+{
+    int count = 0;
+    for (Block *block = head_; block != nullptr && count < maxIov; block = block->next)
+    {
+        size_t n = block->writerIndex - block->readerIndex;
+        if (n == 0)
+        {
+            continue;
+        }
+        iov[count].iov_base = block->data + block->readerIndex;
+        iov[count].iov_len = n;
+        ++count;
+    }
+    return count;
+}
+
+ssize_t BufferChain::writeFd(int fd, int *saveErrno)
+{
+    struct iovec iov[kMaxIov];
+    int count = fillIovec(iov, kMaxIov);
+    ssize_t n = ::writev(fd, iov, count);
+    if (n < 0)
+    {
+        *saveErrno = errno;
+    }
+    return n;
+}
@@ -0,0 +1,72 @@
+#pragma once
+
+#include "noncopyable.h"
+
+#include <string>
+#include <stddef.h>
+#include <stdint.h>
+#include <sys/types.h>
+#include <sys/uio.h>
+
+/**
+ * 分段的缓冲区，由定长的块串成单链表，块从当前线程的BufferPool里取，读完的块马上还回去
+ * 和Buffer相比，追加数据既不会扩容拷贝，也不会挪动已有的数据，几MB的待发送数据不会产生大块的realloc和拷贝
+ * writeFd用writev一次写出多个块
+ *
+ * 接口和Buffer保持一致(readableBytes/peek/retrieve/append/swap/writeFd)，
+ * 不同的是peek()只能看到第一个块里的数据，长度是contiguousBytes()
+ * 用作发送缓冲区；接收缓冲区要把连续的内存交给用户，仍然用Buffer
+ */
+class BufferChain : noncopyable
+{
+public:
+    static const size_t kBlockSize = 16 * 1024;   // 每个块占用的内存，包括块头，正好是BufferPool的一个大小级别
+    static const int kMaxIov = 64;                // writeFd一次最多写出的块数
+
+    BufferChain();
+    ~BufferChain();
+
+    void swap(BufferChain &rhs);
+
+    size_t readableBytes() const { return readableBytes_; }
+    // 第一个块里可读数据的起始地址和长度，没有数据时返回nullptr和0
+    const char* peek() const;
+    size_t contiguousBytes() const;
+
+    void retrieve(size_t len);
+    void retrieveAll();
+    std::string retrieveAllAsString();
+    std::string retrieveAsString(size_t len);
+
+    // 把[data, data+len]追加到最后一个块，写满了再从块池里取新块
+    void append(const char *data, size_t len);
+    // 把rhs的块整个接到最后，不拷贝数据，rhs变成空的
+    void splice(BufferChain &rhs);
+
+    // 从第一个块开始，每个块填一个iovec，最多maxIov个，返回填了几个
+    int fillIovec(struct iovec *iov, int maxIov) const;
+
+    // 通过fd发送数据，不会retrieve，和Buffer::writeFd一样由调用者retrieve
+    ssize_t writeFd(int fd, int *saveErrno);
+
+    // 占用的内存
+    size_t allocatedBytes() const { return numBlocks_ * kBlockSize; }
+
+private:
+    struct Block
+    {
+        Block *next;
+        uint32_t readerIndex;
+        uint32_t writerIndex;
+        char data[kBlockSize - sizeof(Block*) - 2 * sizeof(uint32_t)];
+    };
+    static const size_t kBlockDataSize = sizeof(Block::data);
+
+    Block* allocateBlock();
+    void freeBlock(Block *block);
+
+    Block *head_;
+    Block *tail_;
+    size_t readableBytes_;
+    size_t numBlocks_;
+};
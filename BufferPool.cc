@@ -0,0 +1,118 @@
+#include "BufferPool.h"
+
+#include <new>
+
+const size_t BufferPool::kMinClassSize;
+const size_t BufferPool::kMaxClassSize;
+const int BufferPool::kNumClasses;
+const size_t BufferPool::kMaxCachedBytes;
+
+namespace
+{
+    struct FreeBlock
+    {
+        FreeBlock *next;
+    };
+
+    // 空闲链表和统计都用__thread保存，线程退出清理完以后仍然可以安全访问
+    __thread FreeBlock *t_freeLists[BufferPool::kNumClasses];
+    __thread size_t t_bytesCached = 0;
+    __thread int64_t t_bytesInUse = 0;
+    __thread uint64_t t_allocations = 0;
+    __thread uint64_t t_cacheHits = 0;
+    __thread bool t_poolDestroyed = false;
+
+    // 线程退出时把缓存的内存还给系统
+    struct PoolCleaner
+    {
+        ~PoolCleaner()
+        {
+            for (int i = 0; i < BufferPool::kNumClasses; ++i)
+            {
+                while (t_freeLists[i] != nullptr)
+                {
+                    FreeBlock *block = t_freeLists[i];
+                    t_freeLists[i] = block->next;
+                    ::operator delete(block);
+                }
+            }
+            t_bytesCached = 0;
+            t_poolDestroyed = true;
+        }
+        void touch() {}
+    };
+    thread_local PoolCleaner t_poolCleaner;
+
+    // 大小级别的下标，size必须是kMinClassSize~kMaxClassSize之间的2的幂
+    int classIndex(size_t size)
+    {
+        int index = 0;
+        for (size_t s = BufferPool::kMinClassSize; s < size; s <<= 1)
+        {
+            ++index;
+        }
+        return index;
+    }
+}
+
+size_t BufferPool::roundUp(size_t size)
+{
+    if (size > kMaxClassSize)
+    {
+        return size;
+    }
+    size_t rounded = kMinClassSize;
+    while (rounded < size)
+    {
+        rounded <<= 1;
+    }
+    return rounded;
+}
+
+void* BufferPool::allocate(size_t size)
+{
+    ++t_allocations;
+    t_bytesInUse += static_cast<int64_t>(size);
+    if (size <= kMaxClassSize)
+    {
+        int index = classIndex(size);
+        FreeBlock *block = t_freeLists[index];
+        if (block != nullptr)
+        {
+            t_freeLists[index] = block->next;
+            t_bytesCached -= size;
+            ++t_cacheHits;
+            return block;
+        }
+    }
+    return ::operator new(size);
+}
+
+void BufferPool::deallocate(void *p, size_t size)
+{
+    t_bytesInUse -= static_cast<int64_t>(size);
+    if (size > kMaxClassSize || t_poolDestroyed || t_bytesCached + size > kMaxCachedBytes)
+    {
+        ::operator delete(p);
+        return;
+    }
+    if (t_bytesCached == 0)
+    {
+        t_poolCleaner.touch(); // 第一次缓存的时候注册线程退出时的清理
+    }
+    int index = classIndex(size);
+    FreeBlock *block = static_cast<FreeBlock*>(p);
+    block->next = t_freeLists[index];
+    t_freeLists[index] = block;
+    t_bytesCached += size;
+}
+
+BufferPool::Stats BufferPool::stats()
+{
+    Stats stats;
+    stats.bytesInUse = t_bytesInUse;
+    stats.bytesCached = t_bytesCached;
+    stats.allocations = t_allocations;
+    stats.cacheHits = t_cacheHits;
+    return stats;
+}
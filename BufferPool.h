@@ -0,0 +1,38 @@
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+
+/**
+ * 缓冲区的内存池，Buffer的存储和BufferChain的块都从这里分配
+ * 每个线程一个，不加锁；按2的幂分成kNumClasses个大小级别(1K~64K)，每个级别一个空闲链表，
+ * 整个池最多缓存kMaxCachedBytes字节，多的直接还给系统；超过kMaxClassSize的请求直接走operator new
+ *
+ * 内存可以在别的线程里释放(连接迁移、其它线程send的暂存区)，释放到那个线程的池里
+ * 线程退出时缓存的内存还给系统，之后这个线程里释放的内存直接还给系统
+ */
+class BufferPool
+{
+public:
+    static const size_t kMinClassSize = 1024;
+    static const size_t kMaxClassSize = 64 * 1024;
+    static const int kNumClasses = 7;
+    static const size_t kMaxCachedBytes = 4 * 1024 * 1024;
+
+    // 实际分配的大小：不超过kMaxClassSize时取整到大小级别，否则不变
+    static size_t roundUp(size_t size);
+
+    // size必须是roundUp以后的大小，释放时传入同样的size
+    static void* allocate(size_t size);
+    static void deallocate(void *p, size_t size);
+
+    // 当前线程的统计
+    struct Stats
+    {
+        int64_t bytesInUse;     // 这个线程分配的减去这个线程释放的，跨线程释放时单个线程的值可能是负数
+        size_t bytesCached;     // 空闲链表里缓存的字节数
+        uint64_t allocations;   // allocate的次数
+        uint64_t cacheHits;     // 其中从空闲链表直接拿到的次数
+    };
+    static Stats stats();
+};
@@ -4,6 +4,7 @@
 #include <functional>
 
 class Buffer;
+class EventLoop;
 class TcpConnection;
 class Timestamp;
 
@@ -14,4 +15,6 @@ using WriteCompleteCallback = std::function<void (const TcpConnectionPtr&)>;
 using MessageCallback = std::function<void (const TcpConnectionPtr&,
                                                 Buffer*,
                                                 Timestamp)>;
-using HighWaterMarkCallback = std::function<void (const TcpConnectionPtr&, size_t)>; 
\ No newline at end of file
+using HighWaterMarkCallback = std::function<void (const TcpConnectionPtr&, size_t)>; 
+using MigrateCallback = std::function<void (const TcpConnectionPtr&, EventLoop *newLoop)>;
+using TimerCallback = std::function<void()>;
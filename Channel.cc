@@ -12,7 +12,8 @@ Channel::Channel(EventLoop *loop, int fd) : loop_(loop),
                                             fd_(fd),
                                             events_(0),
                                             revents_(0),
-                                            index_(-1),
+                                            edgeTriggered_(false),
+                                            exclusive_(false),
                                             tied_(false)
 {
 }
@@ -69,7 +70,7 @@ void Channel::handleEvent(Timestamp receiveTime)
 // 根据poller通知的channel发生的具体事件，由channel负责调用具体的回调操作
 void Channel::handleEventWithGuard(Timestamp receiveTime)
 {
-    LOG_INFO("channel handleEvent revents:%d\n", revents_);
+    LOG_DEBUG("channel handleEvent revents:%d\n", revents_);
 
     if((revents_ & EPOLLHUP) && !(revents_ & EPOLLIN)){
         if(closeCallback_)
@@ -37,7 +37,7 @@ public:
 
     int fd() const { return fd_;}
     int events() const { return events_; }
-    int set_revents(int revt) { revents_ = revt; }
+    void set_revents(int revt) { revents_ = revt; }
 
     // 设置fd相应的事件
     //update就是在调用epoll_ctl添加感兴趣的事件 
@@ -47,18 +47,26 @@ public:
     void disableWriting() { events_ &= ~kWriteEvent; update(); } 
     void disableAll() { events_ = kNoneEvent; update(); }
 
+    // 边沿触发(EPOLLET)，事件只在状态变化时通知一次，回调里必须读/写到EAGAIN
+    // 不属于感兴趣的事件，由poller在注册的时候加上
+    void setEdgeTriggered(bool on) { edgeTriggered_ = on; }
+    bool isEdgeTriggered() const { return edgeTriggered_; }
+
+    // EPOLLEXCLUSIVE，多个epoll实例监听同一个fd时，一次事件只唤醒其中一个，用于共享的监听socket
+    // 只在EPOLL_CTL_ADD时生效，设置了以后channel只能注册和删除，不能修改感兴趣的事件
+    void setExclusive(bool on) { exclusive_ = on; }
+    bool isExclusive() const { return exclusive_; }
+
     // 返回fd当前的事件状态
     bool isNoneEvent() const { return events_ == kNoneEvent;}
     bool isWriting() const { return events_ & kWriteEvent; }
     bool isreading() const {return events_ & kReadEvent; }
 
-    // for Poller
-    int index() { return index_; }
-    void set_index(int idx) { index_ = idx; }
-
     // one loop per thread 一个线程有一个EventLoop, 一个EventLoop有一个poller，一个poller上可以监听很多个channel
     // 每个channel都是属于一个EventLoop，一个EventLoop有很多个channel
     EventLoop* ownerLoop() { return loop_; }
+    // 连接迁移用，只能在channel没有注册到任何poller的时候调用
+    void setOwnerLoop(EventLoop *loop) { loop_ = loop; }
     void remove();  //删除channel用的
 
 private:
@@ -74,7 +82,8 @@ private:
     const int fd_;     // fd, Poller监听的对象
     int events_;       // 注册fd感兴趣的事件
     int revents_;      // Poller返回的具体发生的事件
-    int index_;
+    bool edgeTriggered_;
+    bool exclusive_;
     
     // std::weak_ptr 是一种智能指针，它对被 std::shared_ptr 管理的对象存在非拥有性（“弱”）引用。在访问所引用的对象前必须先转换为 std::shared_ptr
     // 弱智能指针只会观察资源，不能使用资源；弱智能指针没有提供*和->运算符重载，不能将弱智能指针当成裸指针看待。
@@ -0,0 +1,121 @@
+#include "CpuAffinity.h"
+#include "Logger.h"
+
+#include <sched.h>
+#include <pthread.h>
+#include <dirent.h>
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <set>
+#include <utility>
+
+namespace
+{
+    // 读取/sys下只有一个整数的文件，失败返回-1
+    int readIntFile(const char *path)
+    {
+        FILE *fp = ::fopen(path, "r");
+        if (fp == nullptr)
+        {
+            return -1;
+        }
+        int value = -1;
+        if (::fscanf(fp, "%d", &value) != 1)
+        {
+            value = -1;
+        }
+        ::fclose(fp);
+        return value;
+    }
+}
+
+namespace CpuAffinity
+{
+    std::vector<int> allowedCpus()
+    {
+        std::vector<int> cpus;
+        cpu_set_t set;
+        CPU_ZERO(&set);
+        if (::sched_getaffinity(0, sizeof set, &set) < 0)
+        {
+            LOG_ERROR("sched_getaffinity error:%d \n", errno);
+            return cpus;
+        }
+        for (int cpu = 0; cpu < CPU_SETSIZE; ++cpu)
+        {
+            if (CPU_ISSET(cpu, &set))
+            {
+                cpus.push_back(cpu);
+            }
+        }
+        return cpus;
+    }
+
+    std::vector<int> physicalCores()
+    {
+        std::vector<int> cores;
+        std::set<std::pair<int, int>> seen; // (physical_package_id, core_id)
+        for (int cpu : allowedCpus())
+        {
+            char path[128];
+            snprintf(path, sizeof path, "/sys/devices/system/cpu/cpu%d/topology/physical_package_id", cpu);
+            int package = readIntFile(path);
+            snprintf(path, sizeof path, "/sys/devices/system/cpu/cpu%d/topology/core_id", cpu);
+            int core = readIntFile(path);
+            if (package < 0 || core < 0)
+            {
+                cores.push_back(cpu); // 没有拓扑信息，每个逻辑cpu都当成一个物理核
+                continue;
+            }
+            if (seen.insert(std::make_pair(package, core)).second)
+            {
+                cores.push_back(cpu);
+            }
+        }
+        return cores;
+    }
+
+    int nodeOfCpu(int cpu)
+    {
+        // cpu目录下有一个指向所属节点的nodeN链接
+        char path[64];
+        snprintf(path, sizeof path, "/sys/devices/system/cpu/cpu%d", cpu);
+        DIR *dir = ::opendir(path);
+        if (dir == nullptr)
+        {
+            return 0;
+        }
+        int node = 0;
+        while (struct dirent *ent = ::readdir(dir))
+        {
+            if (::strncmp(ent->d_name, "node", 4) == 0 && ent->d_name[4] >= '0' && ent->d_name[4] <= '9')
+            {
+                node = ::atoi(ent->d_name + 4);
+                break;
+            }
+        }
+        ::closedir(dir);
+        return node;
+    }
+
+    bool pinCurrentThread(int cpu)
+    {
+        cpu_set_t set;
+        CPU_ZERO(&set);
+        CPU_SET(cpu, &set);
+        int ret = ::pthread_setaffinity_np(::pthread_self(), sizeof set, &set);
+        if (ret != 0)
+        {
+            LOG_ERROR("pthread_setaffinity_np cpu=%d error:%d \n", cpu, ret);
+            return false;
+        }
+        return true;
+    }
+
+    void setCurrentThreadName(const std::string &name)
+    {
+        ::pthread_setname_np(::pthread_self(), name.substr(0, 15).c_str());
+    }
+}
@@ -0,0 +1,23 @@
+#pragma once
+
+#include <vector>
+#include <string>
+
+// cpu绑定和拓扑信息，拓扑从/sys/devices/system/cpu读取，不依赖libnuma
+namespace CpuAffinity
+{
+    // 当前进程允许运行的cpu(sched_getaffinity)，从小到大
+    std::vector<int> allowedCpus();
+
+    // 每个物理核取一个逻辑cpu，超线程的兄弟核不重复使用
+    std::vector<int> physicalCores();
+
+    // cpu所在的NUMA节点，拿不到拓扑信息时返回0
+    int nodeOfCpu(int cpu);
+
+    // 把调用线程绑定到cpu上，失败时返回false
+    bool pinCurrentThread(int cpu);
+
+    // 设置调用线程的名字，超过15个字符的部分会被截掉(pthread_setname_np的限制)
+    void setCurrentThreadName(const std::string &name);
+}
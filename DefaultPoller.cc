@@ -1,5 +1,6 @@
 #include "Poller.h"
 #include "EPollPoller.h"
+#include "IoUringPoller.h"
 
 # include <stdlib.h>
 
@@ -8,6 +9,17 @@ Poller* Poller::newDefaultPoller(EventLoop *loop){
     {
         return nullptr;   // 生成poll的实例
     }
+    else if(getenv("MUDUO_USE_IOURING"))
+    {
+        // 内核不支持或者不允许使用io_uring时退回epoll
+        IoUringPoller *poller = new IoUringPoller(loop);
+        if (poller->valid())
+        {
+            return poller;
+        }
+        delete poller;
+        return new EPollPoller(loop);
+    }
     else{
         return new EPollPoller(loop); // 生成epoll的实例
     }
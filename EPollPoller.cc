@@ -6,11 +6,6 @@
 # include <unistd.h>
 # include <string.h>
 
-// channel的成员变量index表示它在epoll中的状态，初始化为-1
-const int kNew = -1; //表示一个channel还没有添加到poller里面
-const int kAdded = 1; // 表示一个channel已经添加到poller里面
-const int kDeleted = 2; // 表示一个channel已经删除
-
 // 默认情况下子进程会继承父进程所有打开的fd资源
 //但是当父进程创建了一个子进程并切换进子进程的时候，设置了EPOLL_CLOEXEC标志的fd会被关闭
 EPollPoller::EPollPoller(EventLoop *loop) 
@@ -32,15 +27,17 @@ EPollPoller::~EPollPoller(){
 // EventLoop会创建一个channellist，即activeChannels(地址)传给poll，poll通过epoll_wait监听到那些channel发生了事件，把发生了事件的channel填入传入的activeChannels中
 Timestamp EPollPoller::poll(int timeoutMs, ChannelList *activeChannels)
 {
-    // 实际上用LOG_DEBUG输出日志更为合理，只在调试模式下生效，用LOG_INFO会影响程序效率
-    LOG_INFO("func=%s => fd total count:%lu\n", __FUNCTION__, channels_.size());
+    // 每轮都会调用，用LOG_DEBUG只在调试模式下生效，忙轮询模式下每秒会调用上百万次
+    LOG_DEBUG("func=%s => fd total count:%lu\n", __FUNCTION__, numChannels_);
+
+    flushUpdates();
 
     int numEvents = ::epoll_wait(epollfd_, &*events_.begin(), static_cast<int>(events_.size()), timeoutMs);
     int saveErrno = errno;
     Timestamp now(Timestamp::now()); 
 
     if(numEvents > 0){
-        LOG_INFO("%d events happened \n", numEvents);
+        LOG_DEBUG("%d events happened \n", numEvents);
         fillActiveChannels(numEvents, activeChannels);
         if(numEvents == events_.size()){
             events_.resize(events_.size()*2);
@@ -61,26 +58,44 @@ Timestamp EPollPoller::poll(int timeoutMs, ChannelList *activeChannels)
 
 // channel的update和remove 调用 EventLoop的updateChannel和removeChannel 调用Poller的updateChannel和removeChannel
 void EPollPoller::updateChannel(Channel *channel){
-    const int index = channel->index();
-    LOG_INFO("func=%s => fd=%d events=%d index=%d \n", __FUNCTION__, channel->fd(), channel->events(), index);
+    ChannelEntry &entry = entryOf(channel->fd());
+    const int state = entry.state;
+    LOG_DEBUG("func=%s => fd=%d events=%d state=%d \n", __FUNCTION__, channel->fd(), channel->events(), state);
+
+    if (deferUpdates_)
+    {
+        if (state == kNew)
+        {
+            entry.channel = channel;
+            ++numChannels_;
+        }
+        entry.state = channel->isNoneEvent() ? kDeleted : kAdded;
+        if (!entry.dirty)
+        {
+            entry.dirty = true;
+            dirtyFds_.push_back(channel->fd());
+        }
+        // 先按省掉一次记，flush的时候真正调用了epoll_ctl再减回来
+        addCtlCallsSaved(1);
+        return;
+    }
     
-    if(index == kNew || index == kDeleted)
+    if(state == kNew || state == kDeleted)
     {
-        if(index == kNew){
-            int fd = channel->fd();
-            channels_[fd] = channel;
+        if(state == kNew){
+            entry.channel = channel;
+            ++numChannels_;
         }
 
-        channel->set_index(kAdded);
+        entry.state = kAdded;
         update(EPOLL_CTL_ADD, channel);
     }
     else //channel已经在poller上注册过了
     {
-        int fd = channel->fd();
         if (channel->isNoneEvent())
         {
             update(EPOLL_CTL_DEL, channel);
-            channel->set_index(kDeleted);
+            entry.state = kDeleted;
         }
         else
         {
@@ -94,15 +109,64 @@ void EPollPoller::updateChannel(Channel *channel){
 void EPollPoller::removeChannel(Channel *channel)
 {
     int fd = channel->fd();
-    channels_.erase(fd);
+    LOG_DEBUG("func=%s => fd=%d \n", __FUNCTION__, fd);
 
-    LOG_INFO("func=%s => fd=%d \n", __FUNCTION__, fd);
-
-    int index = channel->index();
-    if(index == kAdded){
+    ChannelEntry &entry = entryOf(fd);
+    if(entry.registered){
         update(EPOLL_CTL_DEL, channel);
     }
-    channel->set_index(kNew);
+    if(entry.state != kNew){
+        --numChannels_;
+    }
+    // dirtyFds_里可能还有这个fd，dirty清掉以后flush的时候会跳过
+    entry.channel = nullptr;
+    entry.state = kNew;
+    entry.dirty = false;
+}
+
+void EPollPoller::setDeferredUpdates(bool on)
+{
+    if (!on)
+    {
+        flushUpdates(); // 切回立即更新之前先把积累的修改提交掉
+    }
+    Poller::setDeferredUpdates(on);
+}
+
+void EPollPoller::flushUpdates()
+{
+    for (int fd : dirtyFds_)
+    {
+        ChannelEntry &entry = channels_[fd];
+        if (!entry.dirty)
+        {
+            continue;
+        }
+        entry.dirty = false;
+
+        Channel *channel = entry.channel;
+        bool wanted = entry.state == kAdded;
+        uint32_t events = channel->events() | (channel->isEdgeTriggered() ? static_cast<uint32_t>(EPOLLET) : 0u);
+        if (wanted == entry.registered && (!wanted || events == entry.kernelEvents))
+        {
+            continue; // 这一轮的修改互相抵消了
+        }
+
+        if (!entry.registered)
+        {
+            update(EPOLL_CTL_ADD, channel);
+        }
+        else if (!wanted)
+        {
+            update(EPOLL_CTL_DEL, channel);
+        }
+        else
+        {
+            update(EPOLL_CTL_MOD, channel);
+        }
+        addCtlCallsSaved(-1);
+    }
+    dirtyFds_.clear();
 }
 
 // 填写活跃的连接
@@ -121,9 +185,22 @@ void EPollPoller::update(int operation, Channel *channel){
     bzero(&event, sizeof event);
     int fd = channel->fd();
     event.events = channel->events();
+    if (channel->isEdgeTriggered())
+    {
+        event.events |= EPOLLET;
+    }
     event.data.fd = fd;
     event.data.ptr = channel;
-    
+
+    // 记下内核里的注册状态，延迟更新的时候用来判断修改是否互相抵消了
+    ChannelEntry &entry = entryOf(fd);
+    entry.registered = operation != EPOLL_CTL_DEL;
+    entry.kernelEvents = event.events;
+    if (channel->isExclusive() && operation == EPOLL_CTL_ADD)
+    {
+        // EPOLLEXCLUSIVE只能和EPOLLIN/EPOLLOUT/EPOLLET一起用，带上EPOLLPRI会EINVAL
+        event.events = (event.events & (EPOLLIN | EPOLLOUT | EPOLLET)) | EPOLLEXCLUSIVE;
+    }
 
     if (::epoll_ctl(epollfd_, operation, fd, &event) < 0)
     {
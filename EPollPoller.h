@@ -26,6 +26,7 @@ public:
     Timestamp poll(int timeoutMs, ChannelList *activeChannels) override;
     void updateChannel(Channel *channel) override;
     void removeChannel(Channel *channel) override;
+    void setDeferredUpdates(bool on) override;
 
 private:
     static const int kInitEventListSize = 16; // EventListSize初始的长度
@@ -34,6 +35,8 @@ private:
     void fillActiveChannels(int numEvents, ChannelList *activeChannels) const;
     // 更新channel通道
     void update(int operation, Channel *channel);
+    // 把dirtyFds_里每个fd在内核里的注册状态和channel最终感兴趣的事件同步，每个fd最多一次epoll_ctl
+    void flushUpdates();
 
     // 用来传入epoll实例中的
     // struct epoll_event epevs[1024];
@@ -43,4 +46,5 @@ private:
 
     int epollfd_;   // epoll实例的fd
     EventList events_;
+    std::vector<int> dirtyFds_;  // 延迟更新模式下等待同步的fd
 };
\ No newline at end of file
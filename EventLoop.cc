@@ -2,6 +2,11 @@
 #include "Logger.h"
 #include "Poller.h"
 #include "Channel.h"
+#include "TimerQueue.h"
+#include "TimingWheel.h"
+#include "IoUringPoller.h"
+#include "CpuAffinity.h"
+#include "FixedSizePool.h"
 
 #include <sys/eventfd.h>
 #include <unistd.h>
@@ -11,9 +16,13 @@
 // 防止一个线程创建多个EventLoop  thread_local
 __thread EventLoop *t_loopInthisThread = nullptr;
 
-// 定义默认的Poller IO复用接口的超时时间
+// 定义默认的Poller IO复用接口的超时时间，有定时器时按最早到期时间缩短
 const int kPollTimeMs = 10000;
 
+// 时间轮1秒转一格，512个桶，8分钟以内的超时不需要转第二圈
+const double kWheelTickSeconds = 1.0;
+const size_t kWheelBuckets = 512;
+
 // 创建wakeup,用来notify唤醒subReactor处理新来的channel
 int createEventfd()
 {
@@ -31,8 +40,28 @@ EventLoop::EventLoop()
     , callingPendingFunctors_(false)
     , threadId_(CurrentThread::tid())
     , poller_(Poller::newDefaultPoller(this))
+    , ioUring_(dynamic_cast<IoUringPoller*>(poller_.get()))
+    , timerQueue_(new TimerQueue(this))
     , wakeupFd_(createEventfd())
     , wakeupChannel_(new Channel(this, wakeupFd_))
+    , wakeupPending_(false)
+    , wakeupsIssued_(0)
+    , wakeupsSuppressed_(0)
+    , cpu_(-1)
+    , numaNode_(-1)
+    , busyPollUs_(0)
+    , socketBusyPollUs_(0)
+    , spinning_(false)
+    , busyPollHits_(0)
+    , busyPollBlocks_(0)
+    , numConnections_(0)
+    , bytes_(0)
+    , bytesPerSecond_(0)
+    , loopLagUs_(0)
+    , pendingFunctorBatch_(0)
+    , windowBytes_(0)
+    , windowStartUs_(Timestamp::now().microSecondsSinceEpoch())
+    , connectionPool_(std::make_shared<FixedSizePool>())
     // , currentActiveChannel_(nullptr)
 {
     LOG_DEBUG("EventLoop create %p in thread %d \n", this, threadId_);
@@ -76,7 +105,15 @@ void EventLoop::loop()
     while(!quit_)
     {
         activeChannels_.clear();
-        pollReturnTime_ = poller_->poll(kPollTimeMs, &activeChannels_);
+        int timeoutMs = timerQueue_->nextTimeoutMs(kPollTimeMs);
+        if (busyPollUs_ > 0)
+        {
+            pollReturnTime_ = busyPoll(timeoutMs);
+        }
+        else
+        {
+            pollReturnTime_ = poller_->poll(timeoutMs, &activeChannels_);
+        }
         for (Channel *channel : activeChannels_)
         {
             // Poller监听哪些channel发生事件了，然后上报给EventLoop,通知channel处理相应的事件
@@ -89,12 +126,80 @@ void EventLoop::loop()
          * mainLoop会事先注册一个回调cb（需要subloop来执行），唤醒subloop后执行之前mainloop注册的cb操作，这个cb操作有可能是多个，因此是一个vector容器
          */
         doPendingFunctors();
+        updateLoad();
     }
 
     LOG_INFO("EventLoop %p stop looping. \n", this);
     looping_ = false;
 }
 
+void EventLoop::setCpu(int cpu)
+{
+    cpu_ = cpu;
+    numaNode_ = cpu >= 0 ? CpuAffinity::nodeOfCpu(cpu) : -1;
+}
+
+void EventLoop::updateLoad()
+{
+    int64_t now = Timestamp::now().microSecondsSinceEpoch();
+    int64_t busy = now - pollReturnTime_.microSecondsSinceEpoch();
+    int64_t lag = loopLagUs_.load(std::memory_order_relaxed);
+    loopLagUs_.store((lag * 7 + busy) / 8, std::memory_order_relaxed);
+
+    int64_t elapsed = now - windowStartUs_;
+    if (elapsed >= Timestamp::kMicroSecondsPerSecond)
+    {
+        uint64_t bytes = bytes_.load(std::memory_order_relaxed);
+        bytesPerSecond_.store((bytes - windowBytes_) * Timestamp::kMicroSecondsPerSecond / elapsed,
+            std::memory_order_relaxed);
+        windowBytes_ = bytes;
+        windowStartUs_ = now;
+    }
+}
+
+int64_t EventLoop::loadScore() const
+{
+    return loopLagUs() + pendingFunctorBatch() + static_cast<int64_t>(bytesPerSecond() / 65536);
+}
+
+void EventLoop::setBusyPoll(int spinUs, int socketBusyPollUs)
+{
+    busyPollUs_ = spinUs;
+    socketBusyPollUs_ = socketBusyPollUs;
+}
+
+Timestamp EventLoop::busyPoll(int timeoutMs)
+{
+    int64_t deadline = Timestamp::now().microSecondsSinceEpoch() + busyPollUs_;
+    spinning_.store(true, std::memory_order_relaxed);
+    while (true)
+    {
+        Timestamp now = poller_->poll(0, &activeChannels_);
+        if (!activeChannels_.empty() || !pendingFunctors_.empty() || quit_)
+        {
+            spinning_.store(false, std::memory_order_relaxed);
+            busyPollHits_.fetch_add(1, std::memory_order_relaxed);
+            return now;
+        }
+        if (now.microSecondsSinceEpoch() >= deadline)
+        {
+            break;
+        }
+    }
+
+    // 和wakeup()里的fence配对：要么生产者看到spinning_已经清掉去写eventfd，要么这里看到它入队的回调
+    spinning_.store(false, std::memory_order_relaxed);
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+    if (!pendingFunctors_.empty() || quit_)
+    {
+        busyPollHits_.fetch_add(1, std::memory_order_relaxed);
+        return Timestamp::now();
+    }
+
+    busyPollBlocks_.fetch_add(1, std::memory_order_relaxed);
+    return poller_->poll(timeoutMs, &activeChannels_);
+}
+
 // 退出事件循环  1.loop在自己的线程中调用quit  2.在非loop的线程中，调用loop的quit
 /**
  *              mainLoop
@@ -124,16 +229,13 @@ void EventLoop::runInLoop(Functor cb)
     }
     else // 在非当前loop线程中执行cb , 就需要唤醒loop所在线程，执行cb
     {
-        queueInLoop(cb);
+        queueInLoop(std::move(cb));
     }
 }
 // 把cb放入队列中，唤醒loop所在的线程，执行cb
 void EventLoop::queueInLoop(Functor cb)
 {
-    {
-        std::unique_lock<std::mutex> lock(mutex_);
-        pendingFunctors_.emplace_back(cb);
-    }
+    pendingFunctors_.push(std::move(cb));
 
     // 唤醒相应的，需要执行上面回调操作的loop的线程了
     // || callingPendingFunctors_的意思是：当前loop正在执行回调，但是loop又有了新的回调
@@ -156,6 +258,22 @@ void EventLoop::handleRead()
 // 用来唤醒loop所在的线程的 向wakeupfd_写一个数据, wakeupChannel就发生读事件，当前loop线程就会被唤醒
 void EventLoop::wakeup() 
 {
+    // loop正在忙轮询，马上就会看到新入队的回调，不需要写eventfd
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+    if (spinning_.load(std::memory_order_relaxed))
+    {
+        wakeupsSuppressed_.fetch_add(1, std::memory_order_relaxed);
+        return;
+    }
+
+    // 只有清空标志以后的第一次唤醒需要写eventfd，loop在doPendingFunctors开头清空标志
+    if (wakeupPending_.exchange(true, std::memory_order_acq_rel))
+    {
+        wakeupsSuppressed_.fetch_add(1, std::memory_order_relaxed);
+        return;
+    }
+    wakeupsIssued_.fetch_add(1, std::memory_order_relaxed);
+
     uint64_t one = 1;
     ssize_t n = write(wakeupFd_, &one, sizeof one);
     if (n != sizeof one)
@@ -164,6 +282,37 @@ void EventLoop::wakeup()
     }
 }
 
+TimerId EventLoop::runAt(Timestamp time, TimerCallback cb)
+{
+    return timerQueue_->addTimer(std::move(cb), time, 0.0);
+}
+
+TimerId EventLoop::runAfter(double delay, TimerCallback cb)
+{
+    Timestamp time(addTime(Timestamp::now(), delay));
+    return runAt(time, std::move(cb));
+}
+
+TimerId EventLoop::runEvery(double interval, TimerCallback cb)
+{
+    Timestamp time(addTime(Timestamp::now(), interval));
+    return timerQueue_->addTimer(std::move(cb), time, interval);
+}
+
+void EventLoop::cancel(TimerId timerId)
+{
+    timerQueue_->cancel(timerId);
+}
+
+TimingWheel* EventLoop::timingWheel()
+{
+    if (!timingWheel_)
+    {
+        timingWheel_.reset(new TimingWheel(this, kWheelTickSeconds, kWheelBuckets));
+    }
+    return timingWheel_.get();
+}
+
 // EventLoop的方法 调用 Poller的方法
 void EventLoop::updateChannel(Channel *channel)
 {
@@ -175,6 +324,16 @@ void EventLoop::removeChannel(Channel *channel)
     poller_->removeChannel(channel);
 }
 
+void EventLoop::setDeferredChannelUpdates(bool on)
+{
+    poller_->setDeferredUpdates(on);
+}
+
+uint64_t EventLoop::epollCtlSaved() const
+{
+    return poller_->ctlCallsSaved();
+}
+
 bool EventLoop::hasChannel(Channel *channel)
 {
     return poller_->hasChannel(channel);
@@ -182,20 +341,18 @@ bool EventLoop::hasChannel(Channel *channel)
 
 void EventLoop::doPendingFunctors() // 执行回调
 {
-    std::vector<Functor> functors;
     callingPendingFunctors_ = true;
 
-    // 把pendingFunctors_里的回调函数转移到functors里面，
-    // 出了括号锁就被释放了，后续回调执行不需要持续占用pendingFunctors_，主loop可以继续分发channel
-    {
-        std::unique_lock<std::mutex> lock(mutex_);  
-        functors.swap(pendingFunctors_);
-    }
+    // 先清空唤醒标志再取回调：在这之前入队且唤醒被合并掉的回调，下面一定能取到；
+    // 在这之后入队的回调会重新写eventfd，下一轮poll马上返回
+    wakeupPending_.exchange(false, std::memory_order_acq_rel);
 
-    for (const Functor &functor : functors)
-    {
+    // 只执行进入这个函数之前入队的回调，执行过程中新入队的回调留到下一轮，
+    // 和原来交换vector的语义一致；出队不加锁，其它线程可以继续往队列里放回调
+    size_t count = pendingFunctors_.consume([](Functor &functor) {
         functor();  // 执行当前loop需要执行的回调操作
-    }
+    });
+    pendingFunctorBatch_.store(static_cast<int>(count), std::memory_order_relaxed);
 
     callingPendingFunctors_ = false;
 }
@@ -4,14 +4,21 @@
 #include <vector>
 #include <atomic>
 #include <memory>
-#include <mutex>
+#include <unordered_map>
 
 #include "noncopyable.h"
 #include "Timestamp.h"
 #include "CurrentThread.h"
+#include "Callbacks.h"
+#include "TimerId.h"
+#include "MpscQueue.h"
 
 class Channel;
 class Poller;
+class TimerQueue;
+class TimingWheel;
+class IoUringPoller;
+class FixedSizePool;
 
 // 事件循环类 主要包含了两个大模块 Channel Poller (epoll的抽象)
 class EventLoop : noncopyable
@@ -30,24 +37,102 @@ public:
 
     Timestamp pollReturnTime() const { return pollReturnTime_;}
 
+    /**
+     * 低延迟的忙轮询模式，spinUs>0时开启：每轮先用timeout=0的poll空转最多spinUs微秒，
+     * 期间发现就绪的channel或待执行的回调就立即处理，空转超时才退回阻塞的poll
+     * socketBusyPollUs>0时给这个loop上新建的连接设置SO_BUSY_POLL
+     * 需要在loop()之前或者在loop线程里设置
+     */
+    void setBusyPoll(int spinUs, int socketBusyPollUs = 0);
+    int busyPollUs() const { return busyPollUs_; }
+    int socketBusyPollUs() const { return socketBusyPollUs_; }
+    // 忙轮询期间找到事件的次数 / 空转超时退回阻塞poll的次数
+    uint64_t busyPollHits() const { return busyPollHits_.load(std::memory_order_relaxed); }
+    uint64_t busyPollBlocks() const { return busyPollBlocks_.load(std::memory_order_relaxed); }
+
+    /**
+     * 负载信息，用于EventLoopThreadPool按负载分配连接
+     * loop线程每轮发布一次，都是relaxed原子变量，其它线程读到的是近似值
+     */
+    // 属于这个loop的连接数，TcpConnection构造和析构时修改，可以在任意线程调用
+    void addConnections(int delta) { numConnections_.fetch_add(delta, std::memory_order_relaxed); }
+    int numConnections() const { return numConnections_.load(std::memory_order_relaxed); }
+    // 连接读写的字节数，只能在loop线程里调用
+    void addBytes(size_t n) { bytes_.store(bytes_.load(std::memory_order_relaxed) + n, std::memory_order_relaxed); }
+    // 最近一个统计周期(至少1秒)的读写速率
+    uint64_t bytesPerSecond() const { return bytesPerSecond_.load(std::memory_order_relaxed); }
+    // 每轮处理事件和回调花的时间(微秒)的滑动平均，新的事件至少要等这么久才会被处理
+    int64_t loopLagUs() const { return loopLagUs_.load(std::memory_order_relaxed); }
+    // 最近一轮执行的回调个数，反映跨线程投递过来的积压
+    int pendingFunctorBatch() const { return pendingFunctorBatch_.load(std::memory_order_relaxed); }
+    // 综合负载分数，只用来在loop之间比较大小：loop延迟 + 回调积压 + 每64KB/s记1
+    int64_t loadScore() const;
+
     // 在当前loop中执行cb
     void runInLoop(Functor cb);
     // 把cb放入队列中，唤醒loop所在的线程，执行cb
     void queueInLoop(Functor cb);
     
-    // 用来唤醒loop所在的线程的
+    // 用来唤醒loop所在的线程的，loop还没处理上一次唤醒时不会重复写eventfd
     void wakeup();
+    // 真正写了eventfd的唤醒次数 / 被合并掉的唤醒次数
+    uint64_t wakeupsIssued() const { return wakeupsIssued_.load(std::memory_order_relaxed); }
+    uint64_t wakeupsSuppressed() const { return wakeupsSuppressed_.load(std::memory_order_relaxed); }
+
+    // 定时器接口，线程安全
+    // 在time时刻执行cb
+    TimerId runAt(Timestamp time, TimerCallback cb);
+    // delay秒以后执行cb
+    TimerId runAfter(double delay, TimerCallback cb);
+    // 每隔interval秒执行一次cb
+    TimerId runEvery(double interval, TimerCallback cb);
+    // 取消定时器
+    void cancel(TimerId timerId);
+
+    // 本loop的时间轮，第一次使用时创建，只能在loop线程调用
+    TimingWheel* timingWheel();
+
+    // 本loop上的连接对象用的内存池，见FixedSizePool
+    const std::shared_ptr<FixedSizePool>& connectionPool() const { return connectionPool_; }
+
+    // 使用者挂在loop上的私有数据(比如TcpServer每个loop的连接表)，按key区分，key一般是使用者对象的地址
+    // 只能在loop线程里调用，loop析构时一起释放
+    void setContext(const void *key, const std::shared_ptr<void> &context) { contexts_[key] = context; }
+    // 没有时返回nullptr
+    void* getContext(const void *key) const
+    {
+        auto it = contexts_.find(key);
+        return it == contexts_.end() ? nullptr : it->second.get();
+    }
+    void removeContext(const void *key) { contexts_.erase(key); }
 
     // EventLoop的方法 调用 Poller的方法
     void updateChannel(Channel *channel);
     void removeChannel(Channel *channel);
     bool hasChannel(Channel *channel);
 
+    // loop线程绑定的cpu和所在的NUMA节点，没有绑定时都是-1
+    void setCpu(int cpu);
+    int cpu() const { return cpu_; }
+    int numaNode() const { return numaNode_; }
+
+    // channel感兴趣事件的修改延迟到下一次poll之前按最终状态统一提交，见Poller::setDeferredUpdates
+    // 只能在loop线程里调用
+    void setDeferredChannelUpdates(bool on);
+    // 延迟更新省掉的epoll_ctl次数，可以在任意线程读
+    uint64_t epollCtlSaved() const;
+    // poller是IoUringPoller时返回它，用于完成模式的读写，否则返回nullptr
+    IoUringPoller* ioUringPoller() const { return ioUring_; }
+
     // 判断EventLoop对象是否在自己的线程里面
     bool isInLoopThread() const { return threadId_ == CurrentThread::tid(); }
 private:
     void handleRead();  // wake up
     void doPendingFunctors(); //执行回调
+    // 忙轮询模式下的poll
+    Timestamp busyPoll(int timeoutMs);
+    // 每轮结束时发布负载信息
+    void updateLoad();
 
     using ChannelList = std::vector<Channel*>;
    
@@ -58,15 +143,41 @@ private:
 
     Timestamp pollReturnTime_; // poller返回发生事件的channels的时间点
     std::unique_ptr<Poller> poller_;
+    IoUringPoller *ioUring_;
+    std::unique_ptr<TimerQueue> timerQueue_; // 定时器队列，依赖poller_，必须在poller_之后构造
+    std::unique_ptr<TimingWheel> timingWheel_; // 连接超时用的时间轮，依赖timerQueue_
 
     int wakeupFd_; //主要作用：当mainloop获取一个新用户的channel,通过轮询算法选择一个subloop,通过该成员唤醒subloop处理channel
     std::unique_ptr<Channel> wakeupChannel_;
+    // 已经写过eventfd但loop还没有执行doPendingFunctors，期间的唤醒都可以省掉
+    std::atomic_bool wakeupPending_;
+    std::atomic<uint64_t> wakeupsIssued_;
+    std::atomic<uint64_t> wakeupsSuppressed_;
+
+    int cpu_;
+    int numaNode_;
+
+    int busyPollUs_;
+    int socketBusyPollUs_;
+    std::atomic_bool spinning_; // loop正在忙轮询，其它线程入队回调以后不需要写eventfd
+    std::atomic<uint64_t> busyPollHits_;
+    std::atomic<uint64_t> busyPollBlocks_;
+
+    std::atomic_int numConnections_;
+    std::atomic<uint64_t> bytes_;
+    std::atomic<uint64_t> bytesPerSecond_;
+    std::atomic<int64_t> loopLagUs_;
+    std::atomic_int pendingFunctorBatch_;
+    uint64_t windowBytes_;      // 当前统计周期开始时的bytes_
+    int64_t windowStartUs_;     // 当前统计周期开始的时间
+
+    std::shared_ptr<FixedSizePool> connectionPool_;
+    std::unordered_map<const void*, std::shared_ptr<void>> contexts_;
 
     ChannelList activeChannels_;
     // Channel *currentActiveChannel_;
 
     std::atomic_bool callingPendingFunctors_; // 标识当前loop是否有需要执行的回调操作
-    std::vector<Functor> pendingFunctors_; //存储loop需要执行的所有的回调操作
-    std::mutex mutex_;  // 互斥锁，用来保护上面vector容器的线程安全操作
+    MpscQueue<Functor> pendingFunctors_; //存储loop需要执行的所有的回调操作，其它线程无锁入队
 
 };
\ No newline at end of file
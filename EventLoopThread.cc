@@ -1,14 +1,17 @@
 #include "EventLoopThread.h"
 #include "EventLoop.h"
+#include "CpuAffinity.h"
 
 EventLoopThread::EventLoopThread(const ThreadInitCallback &cb,
-        const std::string &name)
+        const std::string &name,
+        int cpu)
         : loop_(nullptr)
         , exiting_(false)
         , thread_(std::bind(&EventLoopThread::threadFunc, this), name)
         , mutex_()
         , cond_()
         , callback_(cb)
+        , cpu_(cpu)
 {
 
 }
@@ -49,7 +52,17 @@ EventLoop* EventLoopThread::startLoop()
  */
 void EventLoopThread::threadFunc()
 {
+    // 先绑核再创建EventLoop，poller、定时器、连接和Buffer的内存都由这个线程首次访问，分配在本地节点上
+    if (cpu_ >= 0 && !CpuAffinity::pinCurrentThread(cpu_))
+    {
+        cpu_ = -1;
+    }
+
     EventLoop loop; // 创建一个独立的eventloop, 和上面的线程是一一对应的 ==》 one loop per thread
+    if (cpu_ >= 0)
+    {
+        loop.setCpu(cpu_);
+    }
     
     if(callback_)
     {
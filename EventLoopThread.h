@@ -15,7 +15,8 @@ class EventLoopThread :noncopyable
 public:
     using ThreadInitCallback = std::function<void(EventLoop*)>;
     
-    EventLoopThread(const ThreadInitCallback &cb = ThreadInitCallback(), const std::string &name = std::string());
+    // cpu>=0时线程在创建EventLoop之前先绑定到这个cpu上，loop的内存在本地NUMA节点上首次访问(first touch)
+    EventLoopThread(const ThreadInitCallback &cb = ThreadInitCallback(), const std::string &name = std::string(), int cpu = -1);
     ~EventLoopThread();
 
     EventLoop* startLoop();
@@ -28,4 +29,5 @@ private:
     std::mutex mutex_;
     std::condition_variable cond_;
     ThreadInitCallback callback_;
+    int cpu_;
 };
\ No newline at end of file
@@ -1,6 +1,25 @@
 #include "EventLoopThreadPool.h"
 #include "EventLoop.h"
 #include "EventLoopThread.h"
+#include "CpuAffinity.h"
+#include "InetAddress.h"
+
+#include <algorithm>
+#include <unistd.h>
+
+namespace
+{
+    // 64位整数混合到32位哈希值(murmur3的finalizer)，std::hash<int>是恒等映射，不能直接用来建环
+    uint32_t hash32(uint64_t key)
+    {
+        key ^= key >> 33;
+        key *= 0xff51afd7ed558ccdULL;
+        key ^= key >> 33;
+        key *= 0xc4ceb9fe1a85ec53ULL;
+        key ^= key >> 33;
+        return static_cast<uint32_t>(key);
+    }
+}
 
 
 
@@ -10,19 +29,62 @@ EventLoopThreadPool::EventLoopThreadPool(EventLoop *baseLoop, const std::string
     , started_(false)
     , numThreads_(0)
     , next_(0)
+    , busyPollUs_(0)
+    , socketBusyPollUs_(0)
+    , deferredUpdates_(false)
+    , nextIndex_(0)
+    , policy_(kRoundRobin)
+    , randomState_(0x9e3779b97f4a7c15ULL)
     {}
 
+// 退役的loop和正常的loop一样，析构EventLoopThread时退出并回收线程
 EventLoopThreadPool::~EventLoopThreadPool() {}
 
-void EventLoopThreadPool::start(const ThreadInitCallback &cb)
+void EventLoopThreadPool::setCpuAffinityPerPhysicalCore()
+{
+    cpus_ = CpuAffinity::physicalCores();
+}
+
+void EventLoopThreadPool::start(const ThreadInitCallback &userCb)
 {
     started_ = true;
+
+    // 在loop线程开始loop()之前设置好轮询模式和延迟更新，然后再执行用户的初始化回调
+    ThreadInitCallback cb = userCb;
+    if (busyPollUs_ > 0 || socketBusyPollUs_ > 0 || deferredUpdates_)
+    {
+        int spinUs = busyPollUs_;
+        int socketUs = socketBusyPollUs_;
+        bool deferred = deferredUpdates_;
+        cb = [spinUs, socketUs, deferred, userCb](EventLoop *loop) {
+            loop->setBusyPoll(spinUs, socketUs);
+            loop->setDeferredChannelUpdates(deferred);
+            if (userCb)
+            {
+                userCb(loop);
+            }
+        };
+    }
+
+    // cpu到NUMA节点的对应关系只在这里从/sys读一次，getLoopForCpu在accept路径上查表
+    if (!cpus_.empty())
+    {
+        long numCpus = ::sysconf(_SC_NPROCESSORS_CONF);
+        cpuNodes_.resize(numCpus > 0 ? numCpus : 0);
+        for (size_t cpu = 0; cpu < cpuNodes_.size(); ++cpu)
+        {
+            cpuNodes_[cpu] = CpuAffinity::nodeOfCpu(static_cast<int>(cpu));
+        }
+    }
+
+    initCallback_ = cb;
     for(int i=0; i<numThreads_; ++i) {
-        char buf[name_.size() + 32];
-        snprintf(buf, sizeof buf, "%s%d", name_.c_str(), i);
-        EventLoopThread *t = new EventLoopThread(cb, buf);
-        threads_.push_back(std::unique_ptr<EventLoopThread>(t));
-        loops_.push_back(t->startLoop()); // 低层创建线程，绑定一个新的EventLoop,并返回该loop的地址
+        loops_.push_back(startThread(nextIndex_++));
+    }
+
+    if (policy_ == kConsistentHash)
+    {
+        buildHashRing();
     }
 
     // 整个服务器只有一个线程，运行着baseloop
@@ -32,6 +94,82 @@ void EventLoopThreadPool::start(const ThreadInitCallback &cb)
     }
 }
 
+EventLoop* EventLoopThreadPool::startThread(int index)
+{
+    char buf[name_.size() + 32];
+    snprintf(buf, sizeof buf, "%s%d", name_.c_str(), index);
+    int cpu = cpus_.empty() ? -1 : cpus_[index % cpus_.size()];
+    EventLoopThread *t = new EventLoopThread(initCallback_, buf, cpu);
+    threads_.push_back(std::unique_ptr<EventLoopThread>(t));
+    return t->startLoop(); // 低层创建线程，绑定一个新的EventLoop,并返回该loop的地址
+}
+
+EventLoop* EventLoopThreadPool::addLoop()
+{
+    EventLoop *loop = startThread(nextIndex_++);
+    loops_.push_back(loop);
+    numThreads_ = static_cast<int>(loops_.size());
+    if (policy_ == kConsistentHash)
+    {
+        buildHashRing();
+    }
+    return loop;
+}
+
+EventLoop* EventLoopThreadPool::retireLoop()
+{
+    if (loops_.empty())
+    {
+        return nullptr;
+    }
+    RetiredLoop retired;
+    retired.thread = std::move(threads_.back());
+    retired.loop = loops_.back();
+    retired.idleChecks = 0;
+    threads_.pop_back();
+    loops_.pop_back();
+    retired_.push_back(std::move(retired));
+
+    numThreads_ = static_cast<int>(loops_.size());
+    if (next_ >= numThreads_)
+    {
+        next_ = 0;
+    }
+    if (policy_ == kConsistentHash)
+    {
+        buildHashRing();
+    }
+    return retired_.back().loop;
+}
+
+size_t EventLoopThreadPool::reapRetiredLoops()
+{
+    for (auto it = retired_.begin(); it != retired_.end(); )
+    {
+        if (it->loop->numConnections() > 0)
+        {
+            it->idleChecks = 0;
+        }
+        else if (++it->idleChecks >= kRetireGraceChecks)
+        {
+            it = retired_.erase(it); // ~EventLoopThread: quit并join
+            continue;
+        }
+        ++it;
+    }
+    return retired_.size();
+}
+
+std::vector<EventLoop*> EventLoopThreadPool::getRetiredLoops() const
+{
+    std::vector<EventLoop*> loops;
+    for (const RetiredLoop &retired : retired_)
+    {
+        loops.push_back(retired.loop);
+    }
+    return loops;
+}
+
 // 如果工作在多线程中，baseloop_默认以轮询的方式分配channel给subloop
 EventLoop* EventLoopThreadPool::getNextLoop()
 {
@@ -50,6 +188,121 @@ EventLoop* EventLoopThreadPool::getNextLoop()
     return loop;
 }
 
+EventLoop* EventLoopThreadPool::getLoopForConnection(const InetAddress &peerAddr)
+{
+    if (loops_.empty())
+    {
+        return baseLoop_;
+    }
+    if (chooser_)
+    {
+        EventLoop *loop = chooser_(loops_, peerAddr);
+        return loop ? loop : getNextLoop();
+    }
+
+    switch (policy_)
+    {
+    case kLeastConnections:
+        return getLeastConnectionsLoop();
+    case kPowerOfTwoChoices:
+        return getPowerOfTwoChoicesLoop();
+    case kConsistentHash:
+        return getConsistentHashLoop(peerAddr);
+    default:
+        return getNextLoop();
+    }
+}
+
+EventLoop* EventLoopThreadPool::getLeastConnectionsLoop()
+{
+    // 从next_开始找，连接数相同的时候轮流分配
+    size_t best = next_;
+    int bestCount = loops_[best]->numConnections();
+    for (size_t i = 1; i < loops_.size(); ++i)
+    {
+        size_t index = (next_ + i) % loops_.size();
+        int count = loops_[index]->numConnections();
+        if (count < bestCount)
+        {
+            best = index;
+            bestCount = count;
+        }
+    }
+    next_ = static_cast<int>((best + 1) % loops_.size());
+    return loops_[best];
+}
+
+EventLoop* EventLoopThreadPool::getPowerOfTwoChoicesLoop()
+{
+    if (loops_.size() == 1)
+    {
+        return loops_[0];
+    }
+    // xorshift64，只在baseLoop_线程里用，不需要加锁
+    randomState_ ^= randomState_ << 13;
+    randomState_ ^= randomState_ >> 7;
+    randomState_ ^= randomState_ << 17;
+    size_t a = randomState_ % loops_.size();
+    size_t b = (a + 1 + (randomState_ >> 32) % (loops_.size() - 1)) % loops_.size(); // 和a不同
+    return loops_[a]->loadScore() <= loops_[b]->loadScore() ? loops_[a] : loops_[b];
+}
+
+EventLoop* EventLoopThreadPool::getConsistentHashLoop(const InetAddress &peerAddr)
+{
+    if (hashRing_.empty())
+    {
+        buildHashRing();
+    }
+    uint32_t h = hash32(peerAddr.getSockAddr()->sin_addr.s_addr);
+    // 顺时针找到第一个哈希值不小于h的虚拟节点，超过末尾就回到环的开头
+    auto it = std::lower_bound(hashRing_.begin(), hashRing_.end(), h,
+        [](const std::pair<uint32_t, EventLoop*> &node, uint32_t value) { return node.first < value; });
+    if (it == hashRing_.end())
+    {
+        it = hashRing_.begin();
+    }
+    return it->second;
+}
+
+void EventLoopThreadPool::buildHashRing()
+{
+    hashRing_.clear();
+    for (size_t i = 0; i < loops_.size(); ++i)
+    {
+        for (int v = 0; v < kVirtualNodesPerLoop; ++v)
+        {
+            hashRing_.push_back(std::make_pair(hash32((static_cast<uint64_t>(i) << 32) | v), loops_[i]));
+        }
+    }
+    std::sort(hashRing_.begin(), hashRing_.end(),
+        [](const std::pair<uint32_t, EventLoop*> &a, const std::pair<uint32_t, EventLoop*> &b) { return a.first < b.first; });
+}
+
+EventLoop* EventLoopThreadPool::getLoopForCpu(int cpu)
+{
+    if (cpu < 0 || loops_.empty() || cpus_.empty())
+    {
+        return nullptr;
+    }
+
+    // 先找绑定在这个cpu上的loop，再找同一个节点上的loop，多个候选的时候从next_开始轮询
+    int node = static_cast<size_t>(cpu) < cpuNodes_.size() ? cpuNodes_[cpu] : 0;
+    for (int pass = 0; pass < 2; ++pass)
+    {
+        for (size_t i = 0; i < loops_.size(); ++i)
+        {
+            size_t index = (next_ + i) % loops_.size();
+            EventLoop *loop = loops_[index];
+            if (pass == 0 ? loop->cpu() == cpu : loop->numaNode() == node)
+            {
+                next_ = static_cast<int>((index + 1) % loops_.size());
+                return loop;
+            }
+        }
+    }
+    return nullptr;
+}
+
 std::vector<EventLoop*> EventLoopThreadPool::getAllLoops()
 {
     if (loops_.empty())
@@ -58,6 +311,6 @@ std::vector<EventLoop*> EventLoopThreadPool::getAllLoops()
     }
     else
     {
-        loops_;
+        return loops_;
     }
 }
\ No newline at end of file
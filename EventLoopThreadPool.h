@@ -5,29 +5,82 @@
 #include <string>
 #include <vector>
 #include <memory>
+#include <utility>
+#include <stdint.h>
 
 class EventLoop;
 class EventLoopThread;
+class InetAddress;
 
 class EventLoopThreadPool : noncopyable
 {
 public:
     using ThreadInitCallback = std::function<void(EventLoop*)>;
+    // 自定义的分配策略，从loops里给新连接选一个loop
+    using LoopChooser = std::function<EventLoop*(const std::vector<EventLoop*> &loops, const InetAddress &peerAddr)>;
+
+    // 新连接分配给subloop的策略
+    enum LoadBalancePolicy
+    {
+        kRoundRobin,         // 轮询
+        kLeastConnections,   // 连接数最少的loop
+        kPowerOfTwoChoices,  // 随机挑两个loop，取负载分数(EventLoop::loadScore)低的那个
+        kConsistentHash,     // 按对端ip做一致性哈希，同一个客户端总是落在同一个loop上
+    };
 
     EventLoopThreadPool(EventLoop *baseLoop, const std::string &nameArg);
     ~EventLoopThreadPool();
 
     // 设置底层的线程数量
     void setThreadNum(int numThreads) { numThreads_ = numThreads; }
+    // 池里所有loop使用忙轮询模式，含义见EventLoop::setBusyPoll，需要在start之前设置
+    void setBusyPoll(int spinUs, int socketBusyPollUs = 0)
+    {
+        busyPollUs_ = spinUs;
+        socketBusyPollUs_ = socketBusyPollUs;
+    }
+
+    // 池里所有loop使用延迟的channel更新，见EventLoop::setDeferredChannelUpdates，需要在start之前设置
+    void setDeferredChannelUpdates(bool on) { deferredUpdates_ = on; }
+
+    // subloop线程绑核，第i个subloop绑定cpus[i % cpus.size()]，需要在start之前设置
+    // 线程在创建EventLoop之前绑核，loop的内存首次访问时分配在这个cpu的NUMA节点上
+    void setCpuAffinity(const std::vector<int> &cpus) { cpus_ = cpus; }
+    // 每个物理核绑定一个subloop，超线程的兄弟核不用，见CpuAffinity::physicalCores
+    void setCpuAffinityPerPhysicalCore();
 
     void start(const ThreadInitCallback &cb = ThreadInitCallback());
 
+    // 分配策略，需要在start之前设置；设置了chooser时优先使用chooser
+    void setLoadBalancePolicy(LoadBalancePolicy policy) { policy_ = policy; }
+    void setLoopChooser(const LoopChooser &chooser) { chooser_ = chooser; }
+
     // 如果工作在多线程中，baseLoop_默认以轮询的方式分配channel给subloop
     EventLoop* getNextLoop();
+    // 按分配策略给对端地址为peerAddr的新连接选一个loop，只能在baseLoop_线程里调用
+    EventLoop* getLoopForConnection(const InetAddress &peerAddr);
+
+    // 绑定在cpu上的subloop，没有时选一个同一NUMA节点上的subloop(轮询)，都没有返回nullptr
+    // 用于按SO_INCOMING_CPU把连接交给和网卡队列同一个cpu/节点的loop
+    EventLoop* getLoopForCpu(int cpu);
 
     //返回所有的loops
     std::vector<EventLoop*> getAllLoops();
 
+    /**
+     * 运行时调整subloop的个数，都只能在baseLoop_线程里调用，需要在start之后
+     * addLoop: 启动一个新的subloop，马上参与新连接的分配
+     * retireLoop: 最后加入的subloop不再分配新连接，线程继续运行，等它上面的连接关闭或者迁走
+     * reapRetiredLoops: 连接数连续kRetireGraceChecks次检查都为0的退役loop，退出并回收线程，返回还没回收的个数
+     * 连接数为0以后多等一次检查，让其它线程在连接迁走之前投递到旧loop的回调执行完
+     */
+    EventLoop* addLoop();
+    EventLoop* retireLoop();  // 没有subloop时返回nullptr
+    size_t reapRetiredLoops();
+    std::vector<EventLoop*> getRetiredLoops() const;
+    // 正在分配新连接的subloop个数
+    int numThreads() const { return static_cast<int>(loops_.size()); }
+
     bool started() const { return started_; }
     const std::string name() const { return name_; } 
 
@@ -35,11 +88,43 @@ public:
 
 
 private:
+    EventLoop* getLeastConnectionsLoop();
+    EventLoop* getPowerOfTwoChoicesLoop();
+    EventLoop* getConsistentHashLoop(const InetAddress &peerAddr);
+    void buildHashRing();
+
+    // 在subloop线程里创建EventLoop，index用于线程名和绑核
+    EventLoop* startThread(int index);
+
+    static const int kVirtualNodesPerLoop = 100; // 一致性哈希环上每个loop的虚拟节点数
+    static const int kRetireGraceChecks = 2;
+
     EventLoop *baseLoop_; // EventLoop loop;
     std::string name_;
     bool started_;
     int numThreads_;
     int next_;
+    int busyPollUs_;
+    int socketBusyPollUs_;
+    bool deferredUpdates_;
+    std::vector<int> cpus_;
+    std::vector<int> cpuNodes_;  // 以cpu编号为下标的NUMA节点，start时建好
     std::vector<std::unique_ptr<EventLoopThread>> threads_;
     std::vector<EventLoop*> loops_;
+    ThreadInitCallback initCallback_; // start里包装好的线程初始化回调，运行时新加的loop也用它
+    int nextIndex_;                   // 下一个subloop线程的编号
+
+    // 退役的subloop，线程还在运行，idleChecks是连接数连续为0的检查次数
+    struct RetiredLoop
+    {
+        std::unique_ptr<EventLoopThread> thread;
+        EventLoop *loop;
+        int idleChecks;
+    };
+    std::vector<RetiredLoop> retired_;
+
+    LoadBalancePolicy policy_;
+    LoopChooser chooser_;
+    uint64_t randomState_;  // 二选一策略用的xorshift随机数状态
+    std::vector<std::pair<uint32_t, EventLoop*>> hashRing_; // 按哈希值排序的虚拟节点
 };
@@ -0,0 +1,95 @@
+#include "FixedSizePool.h"
+
+#include <new>
+
+const size_t FixedSizePool::kBlocksPerChunk;
+
+// 块的大小按16字节对齐，和operator new的对齐保证一致
+static size_t roundUp(size_t size)
+{
+    return (size + 15) & ~static_cast<size_t>(15);
+}
+
+FixedSizePool::FixedSizePool()
+    : blockSize_(0)
+    , freeList_(nullptr)
+    , numInUse_(0)
+{
+}
+
+FixedSizePool::~FixedSizePool()
+{
+    for (char *chunk : chunks_)
+    {
+        ::operator delete(chunk);
+    }
+}
+
+void* FixedSizePool::allocate(size_t size)
+{
+    size_t rounded = roundUp(size);
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        if (blockSize_ == 0)
+        {
+            blockSize_ = rounded;
+        }
+        if (rounded == blockSize_)
+        {
+            if (freeList_ == nullptr)
+            {
+                allocateChunk();
+            }
+            FreeBlock *block = freeList_;
+            freeList_ = block->next;
+            ++numInUse_;
+            return block;
+        }
+    }
+    return ::operator new(size);
+}
+
+void FixedSizePool::deallocate(void *p, size_t size)
+{
+    if (roundUp(size) != blockSize_)
+    {
+        ::operator delete(p);
+        return;
+    }
+    std::lock_guard<std::mutex> lock(mutex_);
+    FreeBlock *block = static_cast<FreeBlock*>(p);
+    block->next = freeList_;
+    freeList_ = block;
+    --numInUse_;
+}
+
+size_t FixedSizePool::numBlocks() const
+{
+    std::lock_guard<std::mutex> lock(mutex_);
+    return chunks_.size() * kBlocksPerChunk;
+}
+
+size_t FixedSizePool::numInUse() const
+{
+    std::lock_guard<std::mutex> lock(mutex_);
+    return numInUse_;
+}
+
+size_t FixedSizePool::blockSize() const
+{
+    std::lock_guard<std::mutex> lock(mutex_);
+    return blockSize_;
+}
+
+// 调用方持有mutex_
+void FixedSizePool::allocateChunk()
+{
+    char *chunk = static_cast<char*>(::operator new(blockSize_ * kBlocksPerChunk));
+    chunks_.push_back(chunk);
+    for (size_t i = kBlocksPerChunk; i > 0; --i)
+    {
+        FreeBlock *block = reinterpret_cast<FreeBlock*>(chunk + (i - 1) * blockSize_);
+        block->next = freeList_;
+        freeList_ = block;
+    }
+}
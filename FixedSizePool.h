@@ -0,0 +1,76 @@
+#pragma once
+
+#include "noncopyable.h"
+
+#include <memory>
+#include <mutex>
+#include <vector>
+#include <stddef.h>
+#include <stdint.h>
+
+/**
+ * 定长内存块池，每个EventLoop一个，用来分配TcpConnection(连同shared_ptr的控制块)
+ * 块按kBlocksPerChunk个一组向系统申请，释放的块挂到空闲链表上复用，池析构时才还给系统
+ *
+ * 块的大小由第一次allocate决定，之后大小不一样的请求直接走operator new
+ * 连接可能在别的线程里释放(迁移到了别的loop，或者用户在其它线程持有最后一个引用)，所以用锁保护，
+ * 绝大部分时候只有所属loop的线程在用，锁没有竞争
+ */
+class FixedSizePool : noncopyable
+{
+public:
+    static const size_t kBlocksPerChunk = 32;
+
+    FixedSizePool();
+    ~FixedSizePool();
+
+    void* allocate(size_t size);
+    void deallocate(void *p, size_t size);
+
+    // 向系统申请过的块数 / 正在使用的块数 / 块的大小(还没有分配过时是0)
+    size_t numBlocks() const;
+    size_t numInUse() const;
+    size_t blockSize() const;
+
+private:
+    struct FreeBlock
+    {
+        FreeBlock *next;
+    };
+
+    void allocateChunk();
+
+    mutable std::mutex mutex_;
+    size_t blockSize_;
+    FreeBlock *freeList_;
+    std::vector<char*> chunks_;
+    size_t numInUse_;
+};
+
+/**
+ * 从FixedSizePool分配的STL分配器，配合std::allocate_shared使用：
+ * 对象和控制块在同一个块里，控制块里保存着分配器的拷贝，池会活到最后一个对象释放以后
+ */
+template <typename T>
+class PoolAllocator
+{
+public:
+    using value_type = T;
+
+    explicit PoolAllocator(const std::shared_ptr<FixedSizePool> &pool) : pool_(pool) {}
+    template <typename U>
+    PoolAllocator(const PoolAllocator<U> &other) : pool_(other.pool()) {}
+
+    T* allocate(size_t n) { return static_cast<T*>(pool_->allocate(n * sizeof(T))); }
+    void deallocate(T *p, size_t n) { pool_->deallocate(p, n * sizeof(T)); }
+
+    const std::shared_ptr<FixedSizePool>& pool() const { return pool_; }
+
+private:
+    std::shared_ptr<FixedSizePool> pool_;
+};
+
+template <typename T, typename U>
+bool operator==(const PoolAllocator<T> &a, const PoolAllocator<U> &b) { return a.pool() == b.pool(); }
+template <typename T, typename U>
+bool operator!=(const PoolAllocator<T> &a, const PoolAllocator<U> &b) { return a.pool() != b.pool(); }
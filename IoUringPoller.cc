@@ -0,0 +1,743 @@
+# include "IoUringPoller.h"
+# include "Logger.h"
+# include "Channel.h"
+
+# include <errno.h>
+# include <unistd.h>
+# include <string.h>
+# include <time.h>
+# include <sys/mman.h>
+# include <sys/syscall.h>
+# include <sys/socket.h>
+# include <sys/epoll.h>
+# include <algorithm>
+
+// channel的成员变量index表示它在poller中的状态，和EPollPoller的含义一样
+
+/**
+ * user_data的含义：
+ * 0                 poll_remove/cancel之类不需要处理的请求
+ * 最高位是1         poll请求，62~32位是请求的编号，低32位是fd
+ * 其它              读写请求，值就是IoUringOp的地址
+ */
+static const uint64_t kPollTag = 1ULL << 63;
+
+static inline uint64_t makeUserData(int fd, uint32_t generation)
+{
+    return kPollTag | static_cast<uint64_t>(generation) << 32 | static_cast<uint32_t>(fd);
+}
+
+static int sysIoUringSetup(unsigned entries, io_uring_params *params)
+{
+    return static_cast<int>(::syscall(__NR_io_uring_setup, entries, params));
+}
+
+static int sysIoUringEnter(int fd, unsigned toSubmit, unsigned minComplete, unsigned flags, void *arg, size_t argSize)
+{
+    return static_cast<int>(::syscall(__NR_io_uring_enter, fd, toSubmit, minComplete, flags, arg, argSize));
+}
+
+IoUringPoller::IoUringPoller(EventLoop *loop)
+    : Poller(loop)
+    , ringFd_(-1)
+    , nextGeneration_(1)
+    , sqRing_(nullptr)
+    , sqRingSize_(0)
+    , sqes_(nullptr)
+    , sqesSize_(0)
+    , sqLocalTail_(0)
+    , cqRing_(nullptr)
+    , cqRingSize_(0)
+    , completionChannel_(loop, -1)
+    , completionChannelActive_(false)
+    , buffersState_(0)
+    , bufferBase_(nullptr)
+{
+    completionChannel_.setReadCallback(std::bind(&IoUringPoller::dispatchCompletions, this));
+    if (!setupRing())
+    {
+        teardownRing();
+    }
+}
+
+IoUringPoller::~IoUringPoller()
+{
+    // 关闭ring以后内核会取消所有请求，释放请求发起者的guard，
+    // 先转移到局部变量里，guard释放时发起者可能被析构
+    std::vector<std::shared_ptr<void>> guards;
+    for (IoUringOp *op : inflightOps_)
+    {
+        op->inflight = false;
+        guards.push_back(std::move(op->guard));
+    }
+    inflightOps_.clear();
+
+    teardownRing();
+    delete[] bufferBase_;
+}
+
+bool IoUringPoller::setupRing()
+{
+    io_uring_params params;
+    ::memset(&params, 0, sizeof params);
+    params.flags = IORING_SETUP_CQSIZE;
+    params.cq_entries = kCqEntries;
+
+    ringFd_ = sysIoUringSetup(kSqEntries, &params);
+    if (ringFd_ < 0)
+    {
+        LOG_ERROR("io_uring_setup error:%d, fall back to epoll \n", errno);
+        return false;
+    }
+    // 等待事件需要带超时时间，依赖IORING_ENTER_EXT_ARG
+    if (!(params.features & IORING_FEAT_EXT_ARG) || !(params.features & IORING_FEAT_NODROP))
+    {
+        LOG_ERROR("io_uring features 0x%x not enough, fall back to epoll \n", params.features);
+        return false;
+    }
+
+    sqRingSize_ = params.sq_off.array + params.sq_entries * sizeof(unsigned);
+    cqRingSize_ = params.cq_off.cqes + params.cq_entries * sizeof(io_uring_cqe);
+    bool singleMmap = params.features & IORING_FEAT_SINGLE_MMAP;
+    if (singleMmap)
+    {
+        sqRingSize_ = cqRingSize_ = std::max(sqRingSize_, cqRingSize_);
+    }
+
+    sqRing_ = ::mmap(nullptr, sqRingSize_, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, ringFd_, IORING_OFF_SQ_RING);
+    if (sqRing_ == MAP_FAILED)
+    {
+        sqRing_ = nullptr;
+        LOG_ERROR("io_uring mmap sq ring error:%d \n", errno);
+        return false;
+    }
+    if (singleMmap)
+    {
+        cqRing_ = sqRing_;
+    }
+    else
+    {
+        cqRing_ = ::mmap(nullptr, cqRingSize_, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, ringFd_, IORING_OFF_CQ_RING);
+        if (cqRing_ == MAP_FAILED)
+        {
+            cqRing_ = nullptr;
+            LOG_ERROR("io_uring mmap cq ring error:%d \n", errno);
+            return false;
+        }
+    }
+    sqesSize_ = params.sq_entries * sizeof(io_uring_sqe);
+    void *sqes = ::mmap(nullptr, sqesSize_, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, ringFd_, IORING_OFF_SQES);
+    if (sqes == MAP_FAILED)
+    {
+        LOG_ERROR("io_uring mmap sqes error:%d \n", errno);
+        return false;
+    }
+    sqes_ = static_cast<io_uring_sqe*>(sqes);
+
+    char *sq = static_cast<char*>(sqRing_);
+    sqHead_ = reinterpret_cast<unsigned*>(sq + params.sq_off.head);
+    sqTail_ = reinterpret_cast<unsigned*>(sq + params.sq_off.tail);
+    sqArray_ = reinterpret_cast<unsigned*>(sq + params.sq_off.array);
+    sqMask_ = *reinterpret_cast<unsigned*>(sq + params.sq_off.ring_mask);
+    sqEntries_ = *reinterpret_cast<unsigned*>(sq + params.sq_off.ring_entries);
+    sqLocalTail_ = *sqTail_;
+
+    char *cq = static_cast<char*>(cqRing_);
+    cqHead_ = reinterpret_cast<unsigned*>(cq + params.cq_off.head);
+    cqTail_ = reinterpret_cast<unsigned*>(cq + params.cq_off.tail);
+    cqMask_ = *reinterpret_cast<unsigned*>(cq + params.cq_off.ring_mask);
+    cqes_ = reinterpret_cast<io_uring_cqe*>(cq + params.cq_off.cqes);
+    return true;
+}
+
+void IoUringPoller::teardownRing()
+{
+    if (sqes_)
+    {
+        ::munmap(sqes_, sqesSize_);
+        sqes_ = nullptr;
+    }
+    if (cqRing_ && cqRing_ != sqRing_)
+    {
+        ::munmap(cqRing_, cqRingSize_);
+    }
+    cqRing_ = nullptr;
+    if (sqRing_)
+    {
+        ::munmap(sqRing_, sqRingSize_);
+        sqRing_ = nullptr;
+    }
+    if (ringFd_ >= 0)
+    {
+        ::close(ringFd_);
+        ringFd_ = -1;
+    }
+}
+
+io_uring_sqe* IoUringPoller::getSqe()
+{
+    unsigned head = __atomic_load_n(sqHead_, __ATOMIC_ACQUIRE);
+    if (sqLocalTail_ - head >= sqEntries_)
+    {
+        // 提交队列满了，先把已经填好的提交给内核
+        enter(0, 0);
+        head = __atomic_load_n(sqHead_, __ATOMIC_ACQUIRE);
+        if (sqLocalTail_ - head >= sqEntries_)
+        {
+            LOG_FATAL("io_uring submission queue full \n");
+        }
+    }
+    unsigned index = sqLocalTail_ & sqMask_;
+    io_uring_sqe *sqe = &sqes_[index];
+    ::memset(sqe, 0, sizeof *sqe);
+    sqArray_[index] = index;
+    ++sqLocalTail_;
+    return sqe;
+}
+
+int IoUringPoller::enter(unsigned waitNr, int timeoutMs)
+{
+    unsigned toSubmit = sqLocalTail_ - *sqTail_;
+    __atomic_store_n(sqTail_, sqLocalTail_, __ATOMIC_RELEASE);
+
+    unsigned flags = 0;
+    io_uring_getevents_arg arg;
+    __kernel_timespec ts;
+    void *argp = nullptr;
+    size_t argSize = 0;
+    if (waitNr > 0)
+    {
+        flags |= IORING_ENTER_GETEVENTS | IORING_ENTER_EXT_ARG;
+        ::memset(&arg, 0, sizeof arg);
+        if (timeoutMs >= 0)
+        {
+            ts.tv_sec = timeoutMs / 1000;
+            ts.tv_nsec = static_cast<long long>(timeoutMs % 1000) * 1000 * 1000;
+            arg.ts = reinterpret_cast<uint64_t>(&ts);
+        }
+        argp = &arg;
+        argSize = sizeof arg;
+    }
+    else if (toSubmit == 0)
+    {
+        return 0;
+    }
+
+    int ret = sysIoUringEnter(ringFd_, toSubmit, waitNr, flags, argp, argSize);
+    if (ret < 0 && errno != ETIME && errno != EINTR && errno != EBUSY)
+    {
+        LOG_ERROR("io_uring_enter error:%d \n", errno);
+    }
+    return ret;
+}
+
+// 一次io_uring_enter完成：提交这一轮积累的poll_add/poll_remove + 等待事件
+Timestamp IoUringPoller::poll(int timeoutMs, ChannelList *activeChannels)
+{
+    LOG_DEBUG("func=%s => fd total count:%lu\n", __FUNCTION__, numChannels_);
+
+    syncDirty();
+    provideRecycled();
+
+    int numEvents = reapCompletions(activeChannels);
+    if (numEvents == 0)
+    {
+        // 完成队列里已经有事件的话不需要等待，只提交
+        enter(timeoutMs == 0 ? 0 : 1, timeoutMs);
+        numEvents = reapCompletions(activeChannels);
+    }
+    else
+    {
+        enter(0, 0);
+    }
+    Timestamp now(Timestamp::now());
+
+    if (numEvents > 0)
+    {
+        LOG_DEBUG("%d events happened \n", numEvents);
+    }
+    return now;
+}
+
+int IoUringPoller::reapCompletions(ChannelList *activeChannels)
+{
+    int numEvents = 0;
+    unsigned head = *cqHead_;
+    unsigned tail = __atomic_load_n(cqTail_, __ATOMIC_ACQUIRE);
+    for (; head != tail; ++head)
+    {
+        const io_uring_cqe &cqe = cqes_[head & cqMask_];
+        if (cqe.user_data == 0)
+        {
+            continue; // poll_remove/cancel/provide_buffers的完成事件
+        }
+        if (!(cqe.user_data & kPollTag))
+        {
+            Completion c = { reinterpret_cast<IoUringOp*>(cqe.user_data), cqe.res, cqe.flags };
+            completions_.push_back(c);
+            continue;
+        }
+
+        uint32_t generation = static_cast<uint32_t>((cqe.user_data & ~kPollTag) >> 32);
+        int fd = static_cast<int>(static_cast<uint32_t>(cqe.user_data));
+
+        if (static_cast<size_t>(fd) >= states_.size() || states_[fd].generation != generation)
+        {
+            continue; // 已经被取消或者替换掉的poll请求
+        }
+
+        // oneshot的poll请求完成以后就失效了，下一轮poll的时候重新提交
+        states_[fd].generation = 0;
+        markDirty(fd);
+
+        if (cqe.res < 0)
+        {
+            if (cqe.res != -ECANCELED)
+            {
+                LOG_ERROR("io_uring poll fd=%d error:%d \n", fd, -cqe.res);
+            }
+            continue;
+        }
+
+        Channel *channel = channelOf(fd);
+        if (channel)
+        {
+            channel->set_revents(cqe.res);
+            activeChannels->push_back(channel);
+            ++numEvents;
+        }
+    }
+    __atomic_store_n(cqHead_, head, __ATOMIC_RELEASE);
+
+    // 读写完成事件通过内部channel交给EventLoop，和其它就绪的channel一起处理
+    if (!completions_.empty() && !completionChannelActive_)
+    {
+        completionChannelActive_ = true;
+        completionChannel_.set_revents(EPOLLIN);
+        activeChannels->push_back(&completionChannel_);
+        ++numEvents;
+    }
+    return numEvents;
+}
+
+void IoUringPoller::dispatchCompletions()
+{
+    completionChannelActive_ = false;
+
+    std::vector<Completion> completions;
+    completions.swap(completions_);
+    for (const Completion &c : completions)
+    {
+        IoUringOp *op = c.op;
+        // 没有IORING_CQE_F_MORE说明这个请求结束了，回调执行完以后释放guard
+        std::shared_ptr<void> guard;
+        if (!(c.flags & IORING_CQE_F_MORE))
+        {
+            op->inflight = false;
+            inflightOps_.erase(op);
+            guard.swap(op->guard);
+        }
+        if (op->callback)
+        {
+            op->callback(c.res, c.flags);
+        }
+    }
+    // 交换回来复用vector的内存
+    if (completions_.empty())
+    {
+        completions.clear();
+        completions_.swap(completions);
+    }
+}
+
+namespace
+{
+    // 探测用的临时ring，析构时释放
+    struct ProbeRing
+    {
+        ProbeRing() : fd(-1), sqRing(nullptr), sqRingSize(0), cqRing(nullptr), cqRingSize(0), sqes(nullptr), sqesSize(0) {}
+        ~ProbeRing()
+        {
+            if (sqes)
+            {
+                ::munmap(sqes, sqesSize);
+            }
+            if (cqRing && cqRing != sqRing)
+            {
+                ::munmap(cqRing, cqRingSize);
+            }
+            if (sqRing)
+            {
+                ::munmap(sqRing, sqRingSize);
+            }
+            if (fd >= 0)
+            {
+                ::close(fd);
+            }
+        }
+
+        int fd;
+        void *sqRing;
+        size_t sqRingSize;
+        void *cqRing;
+        size_t cqRingSize;
+        void *sqes;
+        size_t sqesSize;
+    };
+
+    void* mapRing(int fd, size_t size, off_t offset)
+    {
+        void *p = ::mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, fd, offset);
+        return p == MAP_FAILED ? nullptr : p;
+    }
+
+    // 在临时ring上对fd提交一次带缓冲区选择的multishot recv，返回是否读到了数据，返回时ring关闭
+    bool recvOnProbeRing(int fd, char *buf, size_t len)
+    {
+        io_uring_params params;
+        ::memset(&params, 0, sizeof params);
+        ProbeRing ring;
+        ring.fd = sysIoUringSetup(4, &params);
+        if (ring.fd < 0 || !(params.features & IORING_FEAT_EXT_ARG))
+        {
+            return false;
+        }
+        ring.sqRingSize = params.sq_off.array + params.sq_entries * sizeof(unsigned);
+        ring.cqRingSize = params.cq_off.cqes + params.cq_entries * sizeof(io_uring_cqe);
+        if (params.features & IORING_FEAT_SINGLE_MMAP)
+        {
+            ring.sqRingSize = ring.cqRingSize = std::max(ring.sqRingSize, ring.cqRingSize);
+        }
+        ring.sqRing = mapRing(ring.fd, ring.sqRingSize, IORING_OFF_SQ_RING);
+        ring.cqRing = (params.features & IORING_FEAT_SINGLE_MMAP) ? ring.sqRing
+                        : mapRing(ring.fd, ring.cqRingSize, IORING_OFF_CQ_RING);
+        ring.sqesSize = params.sq_entries * sizeof(io_uring_sqe);
+        ring.sqes = mapRing(ring.fd, ring.sqesSize, IORING_OFF_SQES);
+        if (!ring.sqRing || !ring.cqRing || !ring.sqes)
+        {
+            return false;
+        }
+
+        char *sq = static_cast<char*>(ring.sqRing);
+        unsigned *sqTail = reinterpret_cast<unsigned*>(sq + params.sq_off.tail);
+        unsigned *sqArray = reinterpret_cast<unsigned*>(sq + params.sq_off.array);
+        io_uring_sqe *sqes = static_cast<io_uring_sqe*>(ring.sqes);
+        ::memset(sqes, 0, 2 * sizeof(io_uring_sqe));
+
+        // 先提供一个缓冲区，链接上recv保证按顺序执行
+        sqes[0].opcode = IORING_OP_PROVIDE_BUFFERS;
+        sqes[0].flags = IOSQE_IO_LINK;
+        sqes[0].fd = 1;
+        sqes[0].addr = reinterpret_cast<uint64_t>(buf);
+        sqes[0].len = static_cast<unsigned>(len);
+        sqes[0].buf_group = 0;
+        sqes[0].off = 0;
+        sqes[0].user_data = 1;
+
+        sqes[1].opcode = IORING_OP_RECV;
+        sqes[1].fd = fd;
+        sqes[1].ioprio = IORING_RECV_MULTISHOT;
+        sqes[1].flags = IOSQE_BUFFER_SELECT;
+        sqes[1].buf_group = 0;
+        sqes[1].user_data = 2;
+
+        unsigned tail = *sqTail;
+        unsigned mask = *reinterpret_cast<unsigned*>(sq + params.sq_off.ring_mask);
+        sqArray[tail & mask] = 0;
+        sqArray[(tail + 1) & mask] = 1;
+        __atomic_store_n(sqTail, tail + 2, __ATOMIC_RELEASE);
+
+        io_uring_getevents_arg arg;
+        __kernel_timespec ts;
+        ::memset(&arg, 0, sizeof arg);
+        ts.tv_sec = 0;
+        ts.tv_nsec = 100 * 1000 * 1000;
+        arg.ts = reinterpret_cast<uint64_t>(&ts);
+        sysIoUringEnter(ring.fd, 2, 2, IORING_ENTER_GETEVENTS | IORING_ENTER_EXT_ARG, &arg, sizeof arg);
+
+        char *cq = static_cast<char*>(ring.cqRing);
+        unsigned head = *reinterpret_cast<unsigned*>(cq + params.cq_off.head);
+        unsigned cqTail = __atomic_load_n(reinterpret_cast<unsigned*>(cq + params.cq_off.tail), __ATOMIC_ACQUIRE);
+        unsigned cqMask = *reinterpret_cast<unsigned*>(cq + params.cq_off.ring_mask);
+        io_uring_cqe *cqes = reinterpret_cast<io_uring_cqe*>(cq + params.cq_off.cqes);
+        for (; head != cqTail; ++head)
+        {
+            const io_uring_cqe &cqe = cqes[head & cqMask];
+            if (cqe.user_data == 2 && cqe.res > 0)
+            {
+                return true;
+            }
+        }
+        return false;
+    }
+
+    /**
+     * 在socketpair上试一次multishot recv，读到数据说明内核支持
+     * 5.11~5.19的内核支持IORING_FEAT_EXT_ARG，但recv不认识IORING_RECV_MULTISHOT，会以-EINVAL完成
+     * 用单独的ring探测，不会和正在使用的ring的完成事件混在一起
+     */
+    bool probeMultishotRecv()
+    {
+        int sv[2];
+        if (::socketpair(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0, sv) < 0)
+        {
+            return false;
+        }
+        // ring关闭以后内核异步取消请求，缓冲区用静态的，不用等取消完成
+        static char buf[64];
+        bool supported = ::write(sv[1], "x", 1) == 1 && recvOnProbeRing(sv[0], buf, sizeof buf);
+        ::close(sv[0]);
+        ::close(sv[1]);
+        if (!supported)
+        {
+            LOG_INFO("io_uring multishot recv not supported, completion io falls back to readv/write \n");
+        }
+        return supported;
+    }
+}
+
+// 整个进程只探测一次
+static bool multishotRecvSupported()
+{
+    static const bool supported = probeMultishotRecv();
+    return supported;
+}
+
+bool IoUringPoller::supportsCompletionIo()
+{
+    if (buffersState_ == 0)
+    {
+        buffersState_ = setupBuffers() ? 1 : -1;
+    }
+    return buffersState_ == 1;
+}
+
+bool IoUringPoller::setupBuffers()
+{
+    if (!valid() || !multishotRecvSupported())
+    {
+        return false;
+    }
+    bufferBase_ = new char[kBufferCount * kBufferSize];
+    for (unsigned i = 0; i < kBufferCount; ++i)
+    {
+        recycledBuffers_.push_back(static_cast<uint16_t>(i));
+    }
+    provideRecycled();
+    return true;
+}
+
+void IoUringPoller::recycleBuffer(uint16_t bid)
+{
+    recycledBuffers_.push_back(bid);
+}
+
+void IoUringPoller::provideRecycled()
+{
+    if (recycledBuffers_.empty())
+    {
+        return;
+    }
+    std::sort(recycledBuffers_.begin(), recycledBuffers_.end());
+    size_t i = 0;
+    while (i < recycledBuffers_.size())
+    {
+        size_t j = i + 1;
+        while (j < recycledBuffers_.size() && recycledBuffers_[j] == recycledBuffers_[j-1] + 1)
+        {
+            ++j;
+        }
+        uint16_t first = recycledBuffers_[i];
+        io_uring_sqe *sqe = getSqe();
+        sqe->opcode = IORING_OP_PROVIDE_BUFFERS;
+        sqe->fd = static_cast<int>(j - i);  // 缓冲区个数
+        sqe->addr = reinterpret_cast<uint64_t>(bufferData(first));
+        sqe->len = kBufferSize;
+        sqe->buf_group = kBufferGroup;
+        sqe->off = first;                    // 起始编号
+        sqe->user_data = 0;
+        i = j;
+    }
+    recycledBuffers_.clear();
+}
+
+void IoUringPoller::track(IoUringOp *op, const std::shared_ptr<void> &guard)
+{
+    op->inflight = true;
+    op->guard = guard;
+    inflightOps_.insert(op);
+}
+
+void IoUringPoller::submitRecv(int fd, IoUringOp *op, const std::shared_ptr<void> &guard)
+{
+    // 重新提交的recv通常是因为缓冲区用完了，先把回收的缓冲区还给内核
+    provideRecycled();
+    track(op, guard);
+    io_uring_sqe *sqe = getSqe();
+    sqe->opcode = IORING_OP_RECV;
+    sqe->fd = fd;
+    sqe->ioprio = IORING_RECV_MULTISHOT;
+    sqe->flags = IOSQE_BUFFER_SELECT;
+    sqe->buf_group = kBufferGroup;
+    sqe->user_data = reinterpret_cast<uint64_t>(op);
+}
+
+void IoUringPoller::submitSend(int fd, const void *data, size_t len, IoUringOp *op, const std::shared_ptr<void> &guard)
+{
+    track(op, guard);
+    io_uring_sqe *sqe = getSqe();
+    sqe->opcode = IORING_OP_SEND;
+    sqe->fd = fd;
+    sqe->addr = reinterpret_cast<uint64_t>(data);
+    sqe->len = static_cast<uint32_t>(len);
+    sqe->msg_flags = MSG_NOSIGNAL;
+    sqe->user_data = reinterpret_cast<uint64_t>(op);
+}
+
+void IoUringPoller::submitSendmsg(int fd, int iovcnt, IoUringSendOp *op, const std::shared_ptr<void> &guard)
+{
+    ::memset(&op->msg, 0, sizeof op->msg);
+    op->msg.msg_iov = op->iov;
+    op->msg.msg_iovlen = iovcnt;
+
+    track(op, guard);
+    io_uring_sqe *sqe = getSqe();
+    sqe->opcode = IORING_OP_SENDMSG;
+    sqe->fd = fd;
+    sqe->addr = reinterpret_cast<uint64_t>(&op->msg);
+    sqe->len = 1;
+    sqe->msg_flags = MSG_NOSIGNAL;
+    sqe->user_data = reinterpret_cast<uint64_t>(op);
+}
+
+void IoUringPoller::cancel(IoUringOp *op)
+{
+    if (!op->inflight)
+    {
+        return;
+    }
+    io_uring_sqe *sqe = getSqe();
+    sqe->opcode = IORING_OP_ASYNC_CANCEL;
+    sqe->fd = -1;
+    sqe->addr = reinterpret_cast<uint64_t>(op);
+    sqe->user_data = 0;
+}
+
+void IoUringPoller::markDirty(int fd)
+{
+    if (static_cast<size_t>(fd) >= states_.size())
+    {
+        states_.resize(channels_.size(), PollState{0, 0, false}); // 和channels_一起按2倍扩容
+    }
+    PollState &state = states_[fd];
+    if (!state.dirty)
+    {
+        state.dirty = true;
+        dirtyFds_.push_back(fd);
+    }
+}
+
+void IoUringPoller::syncDirty()
+{
+    for (int fd : dirtyFds_)
+    {
+        PollState &state = states_[fd];
+        state.dirty = false;
+
+        uint32_t events = 0;
+        const ChannelEntry &entry = channels_[fd];
+        if (entry.channel && entry.state == kAdded)
+        {
+            events = static_cast<uint32_t>(entry.channel->events());
+        }
+
+        if (state.generation != 0 && state.events == events)
+        {
+            addCtlCallsSaved(1);
+            continue; // 内核里的请求已经是想要的状态了
+        }
+        if (state.generation != 0)
+        {
+            cancelPoll(fd, &state);
+        }
+        if (events != 0)
+        {
+            armPoll(fd, &state, events);
+        }
+    }
+    dirtyFds_.clear();
+}
+
+void IoUringPoller::armPoll(int fd, PollState *state, uint32_t events)
+{
+    state->generation = nextGeneration_;
+    nextGeneration_ = (nextGeneration_ + 1) & 0x7fffffff; // 编号只有31位
+    if (nextGeneration_ == 0)
+    {
+        nextGeneration_ = 1;
+    }
+    state->events = events;
+
+    io_uring_sqe *sqe = getSqe();
+    sqe->opcode = IORING_OP_POLL_ADD;
+    sqe->fd = fd;
+    sqe->poll32_events = events;  // 小端机器上poll32_events和epoll的事件位一致
+    sqe->user_data = makeUserData(fd, state->generation);
+}
+
+void IoUringPoller::cancelPoll(int fd, PollState *state)
+{
+    io_uring_sqe *sqe = getSqe();
+    sqe->opcode = IORING_OP_POLL_REMOVE;
+    sqe->fd = -1;
+    sqe->addr = makeUserData(fd, state->generation); // 按user_data找到要取消的poll请求
+    sqe->user_data = 0;
+    state->generation = 0;
+}
+
+// channel的update和remove 调用 EventLoop的updateChannel和removeChannel 调用Poller的updateChannel和removeChannel
+void IoUringPoller::updateChannel(Channel *channel)
+{
+    int fd = channel->fd();
+    ChannelEntry &entry = entryOf(fd);
+    LOG_DEBUG("func=%s => fd=%d events=%d state=%d \n", __FUNCTION__, fd, channel->events(), entry.state);
+
+    if (entry.state == kNew)
+    {
+        entry.channel = channel;
+        ++numChannels_;
+    }
+    entry.state = channel->isNoneEvent() ? kDeleted : kAdded;
+    // 不马上提交，到poll的时候按最终的状态提交一次
+    if (states_.size() > static_cast<size_t>(fd) && states_[fd].dirty)
+    {
+        addCtlCallsSaved(1); // 和这一轮之前的修改合并了
+    }
+    markDirty(fd);
+}
+
+// 从poller中删除channel
+void IoUringPoller::removeChannel(Channel *channel)
+{
+    int fd = channel->fd();
+    LOG_DEBUG("func=%s => fd=%d \n", __FUNCTION__, fd);
+
+    ChannelEntry &entry = entryOf(fd);
+    if (entry.state != kNew)
+    {
+        --numChannels_;
+    }
+    entry.channel = nullptr;
+    entry.state = kNew;
+
+    if (static_cast<size_t>(fd) < states_.size())
+    {
+        PollState &state = states_[fd];
+        if (state.generation != 0)
+        {
+            cancelPoll(fd, &state);
+        }
+        // dirtyFds_里可能还有这个fd，同步的时候channel已经不在了，不会再提交
+        state.events = 0;
+    }
+}
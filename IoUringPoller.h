@@ -0,0 +1,170 @@
+# pragma once
+
+# include "Poller.h"
+# include "Timestamp.h"
+
+# include "Channel.h"
+
+# include <vector>
+# include <memory>
+# include <functional>
+# include <unordered_set>
+# include <linux/io_uring.h>
+# include <sys/socket.h>
+# include <sys/uio.h>
+
+/**
+ * 提交给io_uring的异步读写请求，由发起者(TcpConnection)持有
+ * 完成事件在loop线程里通过callback回调，res是系统调用的返回值，flags是cqe的flags
+ * guard在请求提交时设置，保证请求结束之前发起者不会被析构，最后一个完成事件回调以后释放
+ */
+struct IoUringOp
+{
+    using Callback = std::function<void(int res, uint32_t flags)>;
+
+    IoUringOp() : inflight(false) {}
+
+    Callback callback;
+    std::shared_ptr<void> guard;
+    bool inflight;
+};
+
+/**
+ * 一次发送多段不连续数据的send请求(IORING_OP_SENDMSG)，msg和iov属于请求，完成之前保持有效
+ */
+struct IoUringSendOp : IoUringOp
+{
+    static const int kMaxIov = 16;
+
+    struct msghdr msg;
+    struct iovec iov[kMaxIov];
+};
+
+/**
+ * @brief 
+ * 基于io_uring的Poller，直接用io_uring_setup/io_uring_enter系统调用，不依赖liburing
+ * 每个channel对应一个IORING_OP_POLL_ADD请求，channel感兴趣事件的变化先记下来，
+ * 到下一次poll的时候把所有的poll_add/poll_remove和等待事件合并成一次io_uring_enter
+ * 相当于总是工作在延迟更新模式，setDeferredUpdates不起作用
+ *
+ * 用的是单次(oneshot)poll，事件上报以后在下一轮重新提交，重新提交时内核会检查当前状态，
+ * 保持和epoll LT模式一样的语义；multishot poll只在有新的唤醒时才上报，读一次没读完的数据会丢事件
+ *
+ * channel的边沿触发标志在这里不起作用，边沿触发模式的回调本来就会读/写到EAGAIN，按水平触发处理也是正确的
+ *
+ * 需要内核支持IORING_FEAT_EXT_ARG(5.11+)，不支持或者被禁止使用io_uring时valid()返回false，
+ * 由Poller::newDefaultPoller退回到EPollPoller
+ */
+class IoUringPoller : public Poller
+{
+public:
+    IoUringPoller(EventLoop *loop);
+    ~IoUringPoller() override;
+
+    bool valid() const { return ringFd_ >= 0; }
+
+    /**
+     * 完成模式的读写接口，TcpConnection用它代替readv/write
+     * 读用multishot recv + 提供给内核的缓冲区组(provided buffers)，数据直接落在预先提供的内存里，
+     * 不需要每个连接常驻一块接收缓冲区；缓冲区在第一次调用supportsCompletionIo时提供给内核
+     * multishot recv需要6.0以上的内核，第一次调用时用一个临时的ring探测一次(整个进程只探测一次)，
+     * 不支持时返回false，连接继续走epoll + readv/write
+     */
+    bool supportsCompletionIo();
+    // 提交multishot recv，每个完成事件带一个缓冲区编号，用完以后要recycleBuffer还回去
+    void submitRecv(int fd, IoUringOp *op, const std::shared_ptr<void> &guard);
+    // 提交send，[data, data+len)在完成之前必须保持有效
+    void submitSend(int fd, const void *data, size_t len, IoUringOp *op, const std::shared_ptr<void> &guard);
+    // 提交sendmsg，发送op->iov的前iovcnt段，各段的内存在完成之前必须保持有效
+    void submitSendmsg(int fd, int iovcnt, IoUringSendOp *op, const std::shared_ptr<void> &guard);
+    // 取消op上正在进行的请求，被取消的请求以-ECANCELED完成
+    void cancel(IoUringOp *op);
+    // 缓冲区编号对应的内存
+    const char* bufferData(uint16_t bid) const { return bufferBase_ + static_cast<size_t>(bid) * kBufferSize; }
+    void recycleBuffer(uint16_t bid);
+
+    // 重写基类Poller的抽象方法
+    Timestamp poll(int timeoutMs, ChannelList *activeChannels) override;
+    void updateChannel(Channel *channel) override;
+    void removeChannel(Channel *channel) override;
+
+private:
+    static const unsigned kSqEntries = 256;
+    static const unsigned kCqEntries = 4096;
+    static const unsigned kBufferCount = 128;       // 提供给内核的缓冲区个数，编号不能超过uint16_t
+    static const size_t kBufferSize = 16 * 1024;    // 每个缓冲区16K
+    static const uint16_t kBufferGroup = 0;
+
+    // 每个fd当前提交到内核的poll请求
+    struct PollState
+    {
+        uint32_t generation;  // 当前poll请求的编号，0表示没有提交
+        uint32_t events;      // 当前poll请求关注的事件
+        bool dirty;           // 已经放进dirtyFds_，等待下一次poll时同步
+    };
+
+    bool setupRing();
+    void teardownRing();
+
+    // 取一个空闲的sqe，提交队列满了就先提交一次
+    io_uring_sqe* getSqe();
+    // 提交所有排队的sqe，waitNr>0时最多等待timeoutMs毫秒
+    int enter(unsigned waitNr, int timeoutMs);
+
+    void markDirty(int fd);
+    // 把dirtyFds_里fd的poll请求和channel感兴趣的事件同步
+    void syncDirty();
+    void armPoll(int fd, PollState *state, uint32_t events);
+    void cancelPoll(int fd, PollState *state);
+    // 收割完成队列，填写活跃的连接
+    int reapCompletions(ChannelList *activeChannels);
+
+    bool setupBuffers();
+    // 把recycledBuffers_还给内核，编号连续的缓冲区合并成一个IORING_OP_PROVIDE_BUFFERS
+    void provideRecycled();
+    void track(IoUringOp *op, const std::shared_ptr<void> &guard);
+    // 在completionChannel_的回调里执行收割到的读写完成事件
+    void dispatchCompletions();
+
+    int ringFd_;
+    uint32_t nextGeneration_;
+
+    // 提交队列
+    void *sqRing_;
+    size_t sqRingSize_;
+    unsigned *sqHead_;
+    unsigned *sqTail_;
+    unsigned *sqArray_;
+    unsigned sqMask_;
+    unsigned sqEntries_;
+    io_uring_sqe *sqes_;
+    size_t sqesSize_;
+    unsigned sqLocalTail_;   // 已经填好但还没有提交的sqe都在[*sqTail_, sqLocalTail_)里
+    // 完成队列
+    void *cqRing_;
+    size_t cqRingSize_;
+    unsigned *cqHead_;
+    unsigned *cqTail_;
+    unsigned cqMask_;
+    io_uring_cqe *cqes_;
+
+    std::vector<PollState> states_;  // 和channels_一样以fd为下标
+    std::vector<int> dirtyFds_;
+
+    // 读写请求的完成事件先收集起来，poll返回以后随活跃channel一起在事件处理阶段回调
+    struct Completion
+    {
+        IoUringOp *op;
+        int res;
+        uint32_t flags;
+    };
+    std::vector<Completion> completions_;
+    Channel completionChannel_;              // 不注册到内核的内部channel，只用来驱动dispatchCompletions
+    bool completionChannelActive_;           // completionChannel_已经放进这一轮的活跃列表
+    std::unordered_set<IoUringOp*> inflightOps_;
+
+    // provided buffers
+    int buffersState_;                       // 0未创建 1可用 -1不可用
+    char *bufferBase_;
+    std::vector<uint16_t> recycledBuffers_;  // 用完等待还给内核的缓冲区编号
+};
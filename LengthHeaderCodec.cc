@@ -0,0 +1,42 @@
+#include "LengthHeaderCodec.h"
+#include "TcpConnection.h"
+#include "Buffer.h"
+#include "Logger.h"
+
+#include <endian.h>
+
+const size_t LengthHeaderCodec::kHeaderLen;
+const size_t LengthHeaderCodec::kDefaultMaxMessageSize;
+
+void LengthHeaderCodec::onMessage(const TcpConnectionPtr &conn, Buffer *buf, Timestamp receiveTime)
+{
+    while (buf->readableBytes() >= kHeaderLen)
+    {
+        const size_t len = static_cast<uint32_t>(buf->peekInt32());
+        if (len > maxMessageSize_)
+        {
+            LOG_ERROR("LengthHeaderCodec invalid length %zu from %s \n", len, conn->name().c_str());
+            conn->forceClose();
+            break;
+        }
+        if (buf->readableBytes() < kHeaderLen + len)
+        {
+            break; // 消息体还没收齐
+        }
+        buf->retrieve(kHeaderLen);
+        messageCallback_(conn, StringPiece(buf->peek(), len), receiveTime);
+        buf->retrieve(len);
+    }
+}
+
+void LengthHeaderCodec::frame(Buffer *buf)
+{
+    buf->prependInt32(static_cast<int32_t>(buf->readableBytes()));
+}
+
+void LengthHeaderCodec::send(const TcpConnectionPtr &conn, const StringPiece &message)
+{
+    // 长度头放在栈上，和消息体作为两段交给连接，消息体不用先拷进临时的Buffer
+    uint32_t be32 = htobe32(static_cast<uint32_t>(message.size()));
+    conn->send(StringPiece(reinterpret_cast<const char*>(&be32), sizeof be32), message);
+}
@@ -0,0 +1,53 @@
+#pragma once
+
+#include "noncopyable.h"
+#include "Callbacks.h"
+#include "StringPiece.h"
+#include "Timestamp.h"
+
+#include <functional>
+#include <stdint.h>
+
+class Buffer;
+
+/**
+ * 长度头编解码：每条消息前面是4字节网络字节序的长度，后面是消息体
+ * 解码直接在连接的输入缓冲区里切消息，回调拿到的是指向缓冲区的StringPiece，回调返回以后才retrieve；
+ * 编码时长度头和消息体作为两段交给TcpConnection::send，消息体直接写socket或追加到发送缓冲区，不经过临时的Buffer；
+ * 自己在Buffer里攒消息体的可以用frame补上长度头再send
+ *
+ *   LengthHeaderCodec codec([](const TcpConnectionPtr &conn, const StringPiece &message, Timestamp) { ... });
+ *   server.setMessageCallback(std::bind(&LengthHeaderCodec::onMessage, &codec, _1, _2, _3));
+ *   codec.send(conn, "hello");
+ *
+ * 长度超过maxMessageSize的连接认为是协议错误，直接forceClose
+ */
+class LengthHeaderCodec : noncopyable
+{
+public:
+    using StringMessageCallback = std::function<void (const TcpConnectionPtr&,
+                                                        const StringPiece&,
+                                                        Timestamp)>;
+
+    static const size_t kHeaderLen = sizeof(int32_t);
+    static const size_t kDefaultMaxMessageSize = 64 * 1024 * 1024;
+
+    explicit LengthHeaderCodec(const StringMessageCallback &cb,
+                            size_t maxMessageSize = kDefaultMaxMessageSize)
+        : messageCallback_(cb)
+        , maxMessageSize_(maxMessageSize)
+    {}
+
+    // 设置成TcpServer的MessageCallback，收齐一条消息回调一次，message只在回调里有效
+    void onMessage(const TcpConnectionPtr &conn, Buffer *buf, Timestamp receiveTime);
+
+    // 在buf的可读数据前面加上长度头，buf里原来的数据就是消息体
+    static void frame(Buffer *buf);
+
+    // 编码并发送一条消息
+    void send(const TcpConnectionPtr &conn, const StringPiece &message);
+
+private:
+    StringMessageCallback messageCallback_;
+    size_t maxMessageSize_;
+};
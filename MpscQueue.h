@@ -0,0 +1,197 @@
+#pragma once
+
+#include "noncopyable.h"
+#include "Logger.h"
+
+#include <atomic>
+#include <mutex>
+#include <utility>
+#include <stdint.h>
+#include <stddef.h>
+
+/**
+ * 多生产者单消费者的无锁队列(Vyukov侵入式链表队列)
+ * push可以在任意线程调用，只需要一次exchange，生产者之间互不等待；pop/consume只能在消费者线程调用
+ *
+ * 节点池化复用：消费完的节点放回空闲栈，生产者优先从空闲栈取节点，稳定以后入队不再分配内存
+ * 空闲栈有多个线程同时弹出，为了避免ABA问题，节点按块分配，用"版本号+下标"组成的64位值作为栈顶
+ * 块的大小从kFirstChunkSize开始逐块翻倍，最初的哨兵节点是对象自带的，没有入过队的队列不分配节点
+ */
+template <typename T>
+class MpscQueue : noncopyable
+{
+public:
+    MpscQueue()
+        : freeTop_(0)
+        , numNodes_(0)
+    {
+        for (size_t i = 0; i < kMaxChunks; ++i)
+        {
+            chunks_[i].store(nullptr, std::memory_order_relaxed);
+        }
+        stub_.next.store(nullptr, std::memory_order_relaxed);
+        head_.store(&stub_, std::memory_order_relaxed);
+        tail_ = &stub_;
+    }
+
+    ~MpscQueue()
+    {
+        for (size_t i = 0; i < kMaxChunks; ++i)
+        {
+            delete[] chunks_[i].load(std::memory_order_relaxed);
+        }
+    }
+
+    // 任意线程入队
+    void push(T value)
+    {
+        Node *node = allocNode();
+        node->value = std::move(value);
+        node->next.store(nullptr, std::memory_order_relaxed);
+        Node *prev = head_.exchange(node, std::memory_order_acq_rel);
+        // exchange和下面这句之间消费者看到的链表是断开的，只会认为队列暂时到头了
+        prev->next.store(node, std::memory_order_release);
+    }
+
+    // 消费者线程出队一个元素，队列为空返回false
+    bool pop(T *value)
+    {
+        Node *tail = tail_;
+        Node *next = tail->next.load(std::memory_order_acquire);
+        if (next == nullptr)
+        {
+            return false;
+        }
+        *value = std::move(next->value);
+        next->value = T();
+        tail_ = next;     // next成为新的哨兵节点
+        freeNode(tail);
+        return true;
+    }
+
+    /**
+     * 消费者线程调用，取出调用这一刻之前入队的元素交给f处理，返回处理的个数
+     * f执行过程中新入队的元素留到下一次处理，保证和原来"交换vector再执行"一样的语义
+     */
+    template <typename F>
+    size_t consume(F &&f)
+    {
+        Node *last = head_.load(std::memory_order_acquire);
+        size_t count = 0;
+        T value;
+        while (tail_ != last && pop(&value))
+        {
+            f(value);
+            value = T();
+            ++count;
+        }
+        return count;
+    }
+
+    // 消费者线程调用时是准确的，其它线程调用只能作为参考
+    bool empty() const
+    {
+        return tail_->next.load(std::memory_order_acquire) == nullptr;
+    }
+
+    // 已经分配过的节点个数，用于观察节点池的大小
+    size_t numNodes() const { return numNodes_.load(std::memory_order_relaxed); }
+
+private:
+    struct Node
+    {
+        std::atomic<Node*> next;
+        std::atomic<uint32_t> freeNext; // 在空闲栈里时指向下一个空闲节点，存的是下标+1，0表示栈底
+        uint32_t index;
+        T value;
+    };
+
+    // 第k块有kFirstChunkSize<<k个节点，前k块一共(2^k - 1) * kFirstChunkSize个
+    static const size_t kFirstChunkShift = 6;
+    static const size_t kFirstChunkSize = 1 << kFirstChunkShift; // 第一块64个节点
+    static const size_t kMaxChunks = 17;                         // 最多约8M个节点同时在队列里
+
+    static size_t chunkOf(size_t index)
+    {
+        return 31 - __builtin_clz(static_cast<uint32_t>((index >> kFirstChunkShift) + 1));
+    }
+
+    static size_t chunkBegin(size_t chunkIndex)
+    {
+        return ((static_cast<size_t>(1) << chunkIndex) - 1) << kFirstChunkShift;
+    }
+
+    Node* nodeAt(uint32_t index) const
+    {
+        size_t chunkIndex = chunkOf(index);
+        Node *chunk = chunks_[chunkIndex].load(std::memory_order_acquire);
+        return &chunk[index - chunkBegin(chunkIndex)];
+    }
+
+    Node* allocNode()
+    {
+        uint64_t top = freeTop_.load(std::memory_order_acquire);
+        while (static_cast<uint32_t>(top) != 0)
+        {
+            Node *node = nodeAt(static_cast<uint32_t>(top) - 1);
+            uint32_t next = node->freeNext.load(std::memory_order_relaxed);
+            uint64_t newTop = ((top >> 32) + 1) << 32 | next;
+            // 版本号每次都加一，节点被别人弹出又放回来时CAS也会失败
+            if (freeTop_.compare_exchange_weak(top, newTop, std::memory_order_acq_rel, std::memory_order_acquire))
+            {
+                return node;
+            }
+        }
+        return newNode();
+    }
+
+    void freeNode(Node *node)
+    {
+        if (node == &stub_)
+        {
+            return; // 自带的哨兵不在任何块里，第一次出队以后就不再用了
+        }
+        uint64_t top = freeTop_.load(std::memory_order_relaxed);
+        uint64_t newTop;
+        do
+        {
+            node->freeNext.store(static_cast<uint32_t>(top), std::memory_order_relaxed);
+            newTop = ((top >> 32) + 1) << 32 | (node->index + 1);
+        } while (!freeTop_.compare_exchange_weak(top, newTop, std::memory_order_release, std::memory_order_relaxed));
+    }
+
+    // 空闲栈为空时才会走到这里，按块分配，块内的下标一次领取一个
+    Node* newNode()
+    {
+        size_t index = numNodes_.fetch_add(1, std::memory_order_relaxed);
+        if (index >= chunkBegin(kMaxChunks))
+        {
+            LOG_FATAL("MpscQueue node pool exhausted, %lu nodes \n", index);
+        }
+        size_t chunkIndex = chunkOf(index);
+        if (chunks_[chunkIndex].load(std::memory_order_acquire) == nullptr)
+        {
+            std::lock_guard<std::mutex> lock(chunkMutex_);
+            if (chunks_[chunkIndex].load(std::memory_order_relaxed) == nullptr)
+            {
+                size_t chunkSize = kFirstChunkSize << chunkIndex;
+                Node *chunk = new Node[chunkSize];
+                for (size_t i = 0; i < chunkSize; ++i)
+                {
+                    chunk[i].index = static_cast<uint32_t>(chunkBegin(chunkIndex) + i);
+                }
+                chunks_[chunkIndex].store(chunk, std::memory_order_release);
+            }
+        }
+        return nodeAt(static_cast<uint32_t>(index));
+    }
+
+    std::atomic<Node*> head_; // 生产者入队的一端
+    Node *tail_;              // 消费者出队的一端，指向哨兵节点
+    Node stub_;               // 最初的哨兵
+
+    std::atomic<uint64_t> freeTop_; // 高32位版本号，低32位栈顶节点下标+1
+    std::atomic<size_t> numNodes_;
+    std::atomic<Node*> chunks_[kMaxChunks];
+    std::mutex chunkMutex_;
+};
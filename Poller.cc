@@ -1,12 +1,28 @@
 # include "Poller.h"
 # include "Channel.h"
 
-Poller::Poller(EventLoop *loop) : ownerLoop_(loop)
+const size_t kInitChannelTableSize = 64;
+
+Poller::Poller(EventLoop *loop)
+    : channels_(kInitChannelTableSize, ChannelEntry{nullptr, kNew, 0, false, false})
+    , numChannels_(0)
+    , deferUpdates_(false)
+    , ctlCallsSaved_(0)
+    , ownerLoop_(loop)
 {
 }
 
 bool Poller::hasChannel(Channel *channel) const
 {
-    auto it = channels_.find(channel->fd());
-    return it != channels_.end() && it->second == channel;
+    return channelOf(channel->fd()) == channel;
+}
+
+void Poller::growTable(int fd)
+{
+    size_t size = channels_.size();
+    while (size <= static_cast<size_t>(fd))
+    {
+        size *= 2;
+    }
+    channels_.resize(size, ChannelEntry{nullptr, kNew, 0, false, false});
 }
\ No newline at end of file
@@ -4,7 +4,8 @@
 # include "Timestamp.h"
 
 # include <vector>
-# include <unordered_map>
+# include <atomic>
+# include <stdint.h>
 
 class Channel;
 class EventLoop;
@@ -26,13 +27,66 @@ public:
     // 判断参数channel是否在当前Poller当中
     bool hasChannel(Channel *channel) const;
 
+    // 延迟更新：updateChannel只把fd记到脏列表里，下一次poll之前按channel最终感兴趣的事件统一提交
+    // 同一轮里互相抵消的修改(比如enableWriting后又disableWriting)不会产生系统调用
+    // removeChannel总是立即生效，因为调用以后fd马上会被关闭。只能在loop线程里调用
+    virtual void setDeferredUpdates(bool on) { deferUpdates_ = on; }
+    bool deferredUpdates() const { return deferUpdates_; }
+    // 延迟更新省掉的epoll_ctl(或者io_uring的poll请求)次数
+    uint64_t ctlCallsSaved() const { return ctlCallsSaved_.load(std::memory_order_relaxed); }
+
     // EventLoop可以通过该接口获取默认的IO复用的具体体现
     static Poller* newDefaultPoller(EventLoop *loop);
 protected:
-    // map的key: sockfd value：sockfd所属的channel通道类型
-    using ChannelMap = std::unordered_map<int, Channel*>;
-    ChannelMap channels_;
+    // channel在poller中的状态
+    enum ChannelState
+    {
+        kNew = -1,     // 还没有添加到poller里面
+        kAdded = 1,    // 已经添加到poller里面
+        kDeleted = 2,  // 还在channels_里，但是已经从内核里删除了(没有感兴趣的事件)
+    };
+
+    struct ChannelEntry
+    {
+        Channel *channel;
+        int state;
+        uint32_t kernelEvents;  // 内核里当前注册的事件(包括EPOLLET)
+        bool registered;        // fd是否注册在内核里
+        bool dirty;             // 在等待延迟更新的列表里
+    };
+
+    // 以fd为下标的表，fd是内核从小到大分配的整数，比哈希表少了哈希和节点的分配释放
+    // 不存在的fd对应{nullptr, kNew}
+    using ChannelTable = std::vector<ChannelEntry>;
+
+    // 取fd对应的表项，超过表的大小时按2倍扩容
+    ChannelEntry& entryOf(int fd)
+    {
+        if (static_cast<size_t>(fd) >= channels_.size())
+        {
+            growTable(fd);
+        }
+        return channels_[fd];
+    }
+    // fd上注册的channel，没有时返回nullptr
+    Channel* channelOf(int fd) const
+    {
+        return static_cast<size_t>(fd) < channels_.size() ? channels_[fd].channel : nullptr;
+    }
+
+    // 只有loop线程修改，其它线程可以读
+    void addCtlCallsSaved(int64_t n)
+    {
+        ctlCallsSaved_.store(ctlCallsSaved_.load(std::memory_order_relaxed) + n, std::memory_order_relaxed);
+    }
+
+    ChannelTable channels_;
+    size_t numChannels_;  // channels_里channel的个数
+    bool deferUpdates_;
+    std::atomic<uint64_t> ctlCallsSaved_;
 private:
+    void growTable(int fd);
+
     EventLoop *ownerLoop_; // 定义Poller所属的事件循环EventLoop
 
 };
\ No newline at end of file
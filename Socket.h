@@ -25,6 +25,8 @@ public:
     void setReuseAddr(bool on);
     void setReusePort(bool on);
     void setKeepAlive(bool on);
+    // SO_BUSY_POLL，读socket时在驱动层忙轮询usec微秒
+    void setBusyPoll(int usec);
 
 private:
     const int sockfd_;    
@@ -0,0 +1,80 @@
+#pragma once
+
+#include <string>
+#include <string.h>
+#include <stddef.h>
+
+// 只读的字符串视图，只记录指针和长度，不拥有也不拷贝数据(项目是c++11，没有std::string_view)
+// 可以从const char*、std::string隐式构造，接收字符串的接口用它就不用先拼一个std::string
+// 指向Buffer里的数据时，只在下一次retrieve/append之前有效
+class StringPiece
+{
+public:
+    StringPiece() : ptr_(nullptr), length_(0) {}
+    StringPiece(const char *str) : ptr_(str), length_(str ? ::strlen(str) : 0) {}  // nullptr当作空串
+    StringPiece(const std::string &str) : ptr_(str.data()), length_(str.size()) {}
+    StringPiece(const char *offset, size_t len) : ptr_(offset), length_(len) {}
+
+    const char* data() const { return ptr_; }
+    size_t size() const { return length_; }
+    bool empty() const { return length_ == 0; }
+    const char* begin() const { return ptr_; }
+    const char* end() const { return ptr_ + length_; }
+
+    char operator[](size_t i) const { return ptr_[i]; }
+
+    void remove_prefix(size_t n)
+    {
+        ptr_ += n;
+        length_ -= n;
+    }
+
+    void remove_suffix(size_t n)
+    {
+        length_ -= n;
+    }
+
+    StringPiece substr(size_t pos, size_t n = std::string::npos) const
+    {
+        if (pos > length_)
+        {
+            pos = length_;
+        }
+        if (n > length_ - pos)
+        {
+            n = length_ - pos;
+        }
+        return StringPiece(ptr_ + pos, n);
+    }
+
+    bool starts_with(const StringPiece &x) const
+    {
+        return length_ >= x.length_ && ::memcmp(ptr_, x.ptr_, x.length_) == 0;
+    }
+
+    // 返回c第一次出现的位置，没有时返回std::string::npos
+    size_t find(char c) const
+    {
+        const void *pos = length_ == 0 ? nullptr : ::memchr(ptr_, c, length_);
+        return pos == nullptr ? std::string::npos : static_cast<const char*>(pos) - ptr_;
+    }
+
+    bool operator==(const StringPiece &x) const
+    {
+        return length_ == x.length_ && (length_ == 0 || ::memcmp(ptr_, x.ptr_, length_) == 0);
+    }
+
+    bool operator!=(const StringPiece &x) const
+    {
+        return !(*this == x);
+    }
+
+    std::string as_string() const
+    {
+        return std::string(ptr_, length_);
+    }
+
+private:
+    const char *ptr_;
+    size_t length_;
+};
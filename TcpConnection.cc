@@ -3,6 +3,16 @@
 #include "Socket.h"
 #include "Channel.h"
 #include "EventLoop.h"
+#include "IoUringPoller.h"
+#include "BufferPool.h"
+
+#include <errno.h>
+#include <stdio.h>
+#include <strings.h>
+#include <sys/socket.h>
+#include <sys/uio.h>
+
+const size_t TcpConnection::kDefaultEventByteBudget;
 
 static EventLoop* CheckLoopNotNull(EventLoop *loop)
 {
@@ -14,68 +24,236 @@ static EventLoop* CheckLoopNotNull(EventLoop *loop)
 }
 
 TcpConnection::TcpConnection(EventLoop *loop,
-                                const std::string &nameArg,
+                                const std::shared_ptr<const std::string> &namePrefix,
+                                uint64_t id,
                                 int sockfd,
-                                const InetAddress& localAddr,
                                 const InetAddress& peerAddr)
     : loop_(CheckLoopNotNull(loop))
-    , name_(nameArg)
+    , migrating_(false)
+    , counted_(false)
+    , id_(id)
+    , namePrefix_(namePrefix)
     , state_(kConnecting)
     , reading_(true)
-    , socket_(new Socket(sockfd))
-    , channel_(new Channel(loop, sockfd))
-    , localAddr_(localAddr)
+    , socket_(sockfd)
+    , channel_(loop, sockfd)
     , peerAddr_(peerAddr)
     , highWaterMark_(64*1024*1024) // 64M
+    , hasStaged_(false)
+    , bytesTransferred_(0)
+    , idleTimeout_(0.0)
+    , readTimeout_(0.0)
+    , writeTimeout_(0.0)
+    , bufferShrinkIdle_(kDefaultBufferShrinkIdle)
+    , completionIoRequested_(false)
+    , completionIo_(false)
+    , ioUring_(nullptr)
+    , eventByteBudget_(kDefaultEventByteBudget)
 {
     // 下面给channel设置相应地回调函数，poller给channel通知感兴趣的事件发生了，channel会回调相应的操作函数
-    channel_->setReadCallback(
-        std::bind(&TcpConnection::handleRead, this, std::placeholders::_1)
-    );
-    channel_->setWriteCallback(
-        std::bind(&TcpConnection::handleWrite, this)
-    );
-    channel_->setCloseCallback(
-        std::bind(&TcpConnection::handleClose, this)
-    );
-    channel_->setErrorCallback(
-        std::bind(&TcpConnection::handleError, this)
-    );
+    // 只捕获this的lambda放得进std::function内部的小缓冲区，每个回调不用再单独分配一次内存
+    channel_.setReadCallback([this](Timestamp receiveTime) { handleRead(receiveTime); });
+    channel_.setWriteCallback([this]() { handleWrite(); });
+    channel_.setCloseCallback([this]() { handleClose(); });
+    channel_.setErrorCallback([this]() { handleError(); });
 
-    LOG_INFO("TcpConnection::ctor[%s] at fd=%d\n", name_.c_str(), sockfd);
-    socket_->setKeepAlive(true);
+    idleEntry_.setCallback([this]() { handleTimeout("idle"); });
+    readEntry_.setCallback([this]() { handleTimeout("read"); });
+    writeEntry_.setCallback([this]() { handleTimeout("write"); });
+    bufferEntry_.setCallback([this]() { inputBuffer_.shrinkToFit(); });
+
+    LOG_DEBUG("TcpConnection::ctor[%s] at fd=%d\n", name().c_str(), sockfd);
+    socket_.setKeepAlive(true);
+    if (loop->socketBusyPollUs() > 0)
+    {
+        socket_.setBusyPoll(loop->socketBusyPollUs());
+    }
 }
 
 TcpConnection::~TcpConnection()
 {
-    LOG_INFO("TcpCon nection::dtor[%s] at fd=%d state=%d \n", 
-        name_.c_str(), channel_->fd(), (int)state_);
+    LOG_DEBUG("TcpConnection::dtor[%s] at fd=%d state=%d \n", 
+        name().c_str(), channel_.fd(), (int)state_);
+}
+
+void TcpConnection::uncountFromLoop()
+{
+    if (counted_)
+    {
+        counted_ = false;
+        loop()->addConnections(-1);
+    }
+}
+
+const std::string& TcpConnection::name() const
+{
+    std::call_once(nameOnce_, [this]() {
+        char buf[32];
+        snprintf(buf, sizeof buf, "#%lu", static_cast<unsigned long>(id_));
+        name_ = *namePrefix_ + buf;
+    });
+    return name_;
+}
+
+const InetAddress& TcpConnection::localAddress() const
+{
+    std::call_once(localAddrOnce_, [this]() {
+        sockaddr_in local;
+        ::bzero(&local, sizeof local);
+        socklen_t addrlen = sizeof local;
+        if (::getsockname(socket_.fd(), (sockaddr*)&local, &addrlen) < 0)
+        {
+            LOG_ERROR("sockets::getLocalAddr");
+        }
+        localAddr_ = InetAddress(local);
+    });
+    return localAddr_;
+}
+
+void TcpConnection::send(const StringPiece &message)
+{
+    send(StringPiece(), message);
 }
 
-void TcpConnection::send(const std::string &buf)
+void TcpConnection::send(const void *message, size_t len)
+{
+    send(StringPiece(), StringPiece(static_cast<const char*>(message), len));
+}
+
+void TcpConnection::send(const StringPiece &header, const StringPiece &body)
 {
     if (state_ == kConnected)
     {
-        if (loop_->isInLoopThread())
+        if (!migrating_ && loop()->isInLoopThread())
         {
-            sendInLoop(buf.c_str(), buf.size());
+            if (hasStaged_)
+            {
+                flushStaged(); // 先发其它线程之前暂存的数据
+            }
+            sendInLoop(header, body);
         }
         else
         {
-            loop_->runInLoop(std::bind(
-                &TcpConnection::sendInLoop,
-                this,
-                buf.c_str(),
-                buf.size()
-            ));
+            // 数据拷贝到暂存区，暂存区原来是空的才需要投递一次flushStaged
+            bool needFlush = false;
+            {
+                std::lock_guard<std::mutex> lock(stagingMutex_);
+                needFlush = stagingBuffer_.readableBytes() == 0;
+                stagingBuffer_.append(header.data(), header.size());
+                stagingBuffer_.append(body.data(), body.size());
+                hasStaged_ = true;
+            }
+            if (needFlush)
+            {
+                queueInOwnerLoop(std::bind(&TcpConnection::flushStaged, this));
+            }
+        }
+    }
+}
+
+void TcpConnection::flushStaged()
+{
+    BufferChain staged;
+    {
+        std::lock_guard<std::mutex> lock(stagingMutex_);
+        staged.swap(stagingBuffer_);
+        hasStaged_ = false;
+    }
+    if (staged.readableBytes() == 0)
+    {
+        return;
+    }
+    if (state_ == kDisconnected)
+    {
+        LOG_ERROR("disconnected, give up writing!");
+        return;
+    }
+
+    // 暂存区的块整个接到发送缓冲区后面，和sendInLoop一样：没有待发送的数据就马上writev一次，
+    // 发不完的等epollout，写完成回调最多一次
+    size_t oldLen = outputBuffer_.readableBytes();
+    outputBuffer_.splice(staged);
+    if (completionIo_)
+    {
+        if (!sendOp_->inflight)
+        {
+            startSend();
+        }
+    }
+    else if (!channel_.isWriting() && oldLen == 0)
+    {
+        int savedErrno = 0;
+        ssize_t n = outputBuffer_.writeFd(channel_.fd(), &savedErrno);
+        if (n >= 0)
+        {
+            outputBuffer_.retrieve(n);
+            addTraffic(n);
+            if (outputBuffer_.readableBytes() == 0 && writeCompleteCallback_)
+            {
+                queueInOwnerLoop(
+                    std::bind(writeCompleteCallback_, shared_from_this())
+                );
+            }
+        }
+        else if (savedErrno != EWOULDBLOCK)
+        {
+            errno = savedErrno;
+            LOG_ERROR("TcpConnection::flushStaged");
+            if (savedErrno == EPIPE || savedErrno == ECONNRESET)
+            {
+                outputBuffer_.retrieveAll(); // 连接已经坏了，丢掉这些数据，关闭由读事件驱动
+                return;
+            }
         }
     }
+
+    size_t newLen = outputBuffer_.readableBytes();
+    if (newLen >= highWaterMark_
+        && oldLen < highWaterMark_
+        && highWaterMarkCallback_)
+    {
+        queueInOwnerLoop(
+            std::bind(highWaterMarkCallback_, shared_from_this(), newLen)
+        );
+    }
+    if (!completionIo_ && newLen > 0 && !channel_.isWriting())
+    {
+        channel_.enableWriting();
+        touchTimeout(&writeEntry_, writeTimeout_);
+    }
+}
+
+void TcpConnection::runInOwnerLoop(const std::function<void()> &fn)
+{
+    if (!migrating_ && loop()->isInLoopThread())
+    {
+        fn();
+    }
+    else
+    {
+        queueInOwnerLoop(fn);
+    }
+}
+
+void TcpConnection::queueInOwnerLoop(const std::function<void()> &fn)
+{
+    // 执行时再检查一次，中途连接被迁移走的话继续转发，fn不会在错误的线程里执行
+    loop()->queueInLoop(
+        std::bind(&TcpConnection::runInOwnerLoop, shared_from_this(), fn)
+    );
+}
+
+void TcpConnection::addTraffic(size_t n)
+{
+    bytesTransferred_.store(bytesTransferred_.load(std::memory_order_relaxed) + n, std::memory_order_relaxed);
+    loop()->addBytes(n);
 }
 /**
  * 发送数据 应用写得快，而内核发送数据慢，需要把待发送数据写入缓冲区，而且设置了水位回调
  */
-void TcpConnection::sendInLoop(const void* data, size_t len)
+void TcpConnection::sendInLoop(const StringPiece &header, const StringPiece &body)
 {
+    const size_t len = header.size() + body.size();
     ssize_t nwrote = 0;
     size_t remaining = len;
     bool faultError = false;
@@ -87,17 +265,46 @@ void TcpConnection::sendInLoop(const void* data, size_t len)
         return;
     }
 
+    // 完成模式下不直接write，追加到发送缓冲区，没有正在进行的send时提交一个
+    if (completionIo_)
+    {
+        size_t oldLen = outputBuffer_.readableBytes();
+        if (oldLen + len >= highWaterMark_
+            && oldLen < highWaterMark_
+            && highWaterMarkCallback_)
+        {
+            queueInOwnerLoop(
+                std::bind(highWaterMarkCallback_, shared_from_this(), oldLen+len)
+            );
+        }
+        outputBuffer_.append(header.data(), header.size());
+        outputBuffer_.append(body.data(), body.size());
+        if (!sendOp_->inflight)
+        {
+            startSend();
+        }
+        return;
+    }
+
     // 表示channel_第一次开始写数据，而且缓冲区没有待发送数据
-    if (!channel_->isWriting() && outputBuffer_.readableBytes() == 0)
+    // header和body一次writev写出去，没有header时只有一段
+    if (!channel_.isWriting() && outputBuffer_.readableBytes() == 0)
     {
-        nwrote = ::write(channel_->fd(), data, len);
+        struct iovec vec[2];
+        vec[0].iov_base = const_cast<char*>(header.data());
+        vec[0].iov_len = header.size();
+        vec[1].iov_base = const_cast<char*>(body.data());
+        vec[1].iov_len = body.size();
+        const int first = header.empty() ? 1 : 0;
+        nwrote = ::writev(channel_.fd(), vec + first, 2 - first);
         if (nwrote >= 0)
         {
+            addTraffic(nwrote);
             remaining = len - nwrote;
             if (remaining == 0 && writeCompleteCallback_)
             {
                 // 既然在这里数据全部发送完成，就不再给channel设置epollout事件了
-                loop_->queueInLoop(
+                queueInOwnerLoop(
                     std::bind(writeCompleteCallback_, shared_from_this())
                 );
             }
@@ -127,17 +334,28 @@ void TcpConnection::sendInLoop(const void* data, size_t len)
             && oldLen < highWaterMark_    // 若oldLen > highWaterMark_，表示已经调用过highWaterMarkCallback_
             && highWaterMarkCallback_)
         {
-            loop_->queueInLoop(
+            queueInOwnerLoop(
                 std::bind(highWaterMarkCallback_, shared_from_this(), oldLen+remaining)
             );
         }
-        // 相当于扩容之后把剩余数据继续添加到缓冲区当中
-        outputBuffer_.append((char*)data + nwrote, remaining);
+        // 相当于扩容之后把剩余数据继续添加到缓冲区当中，header没写完时先追加它剩下的部分
+        size_t written = static_cast<size_t>(nwrote);
+        if (written < header.size())
+        {
+            outputBuffer_.append(header.data() + written, header.size() - written);
+            written = 0;
+        }
+        else
+        {
+            written -= header.size();
+        }
+        outputBuffer_.append(body.data() + written, body.size() - written);
         // 这里一定要注册channel的写事件，否则poller不会给channel通知epollout
         // 不通知epollout, 就不会驱动channel调用writecallback,就不会最终调用TcpConnection::handleWrite方法，把发送缓冲区的数据全部发送完成
-        if (!channel_->isWriting())
+        if (!channel_.isWriting())
         {
-            channel_->enableWriting(); 
+            channel_.enableWriting(); 
+            touchTimeout(&writeEntry_, writeTimeout_);
         }
     }
 }
@@ -151,7 +369,7 @@ void TcpConnection::shutdown()
     if (state_ == kConnected)
     {
         setState(kDisconnecting);
-        loop_->runInLoop(
+        runInOwnerLoop(
             std::bind(&TcpConnection::shutdownInLoop, this)
         );
     }
@@ -159,19 +377,221 @@ void TcpConnection::shutdown()
 
 void TcpConnection::shutdownInLoop()
 {
-    if (!channel_->isWriting()) // 说明outputBuffer中的数据已经全部发送完成
+    bool sending = completionIo_ ? sendOp_->inflight : channel_.isWriting();
+    if (!sending) // 说明outputBuffer中的数据已经全部发送完成
+    {
+        socket_.shutdownWrite(); // 关闭写端
+    }
+}
+
+void TcpConnection::forceClose()
+{
+    if (state_ == kConnected || state_ == kDisconnecting)
+    {
+        setState(kDisconnecting);
+        queueInOwnerLoop(
+            std::bind(&TcpConnection::forceCloseInLoop, shared_from_this())
+        );
+    }
+}
+
+void TcpConnection::forceCloseInLoop()
+{
+    if (state_ == kConnected || state_ == kDisconnecting)
+    {
+        // 和对端关闭连接走同样的流程
+        handleClose();
+    }
+}
+
+void TcpConnection::migrateTo(EventLoop *newLoop)
+{
+    queueInOwnerLoop(std::bind(&TcpConnection::migrateInLoop, this, newLoop));
+}
+
+/**
+ * 迁移分两步，中间连接不属于任何poller，期间到达的数据留在socket里，重新注册以后会再报告
+ * 1. 旧loop里：从poller和时间轮上摘下，调用migrateCallback_，把loop_换成新loop，投递attachInLoop
+ *    之后连接不再引用旧loop，旧loop可以随时退出(见TcpServer::resizeThreadPool)
+ * 2. 新loop里：按原来的状态重新注册读写事件和超时
+ * migrating_期间所有投递到连接所属loop的回调(发送、关闭、边沿触发的续读续写)都会转发到新loop，
+ * 排在attachInLoop后面执行，所以迁移前后的发送顺序不变
+ */
+void TcpConnection::migrateInLoop(EventLoop *newLoop)
+{
+    EventLoop *oldLoop = loop();
+    if (state_ != kConnected || completionIo_ || newLoop == nullptr || newLoop == oldLoop)
+    {
+        return; // 完成模式的读写请求挂在旧loop的io_uring上，不能迁移
+    }
+
+    bool wasWriting = channel_.isWriting();
+    channel_.disableAll();
+    channel_.remove();
+    removeTimeouts();
+    // 还在旧loop里通知使用者，回调里投递到newLoop的任务排在attachInLoop前面
+    if (migrateCallback_)
+    {
+        migrateCallback_(shared_from_this(), newLoop);
+    }
+    oldLoop->addConnections(-1);
+    newLoop->addConnections(1);
+
+    migrating_ = true;
+    channel_.setOwnerLoop(newLoop);
+    loop_.store(newLoop, std::memory_order_release);
+    newLoop->queueInLoop(
+        std::bind(&TcpConnection::attachInLoop, shared_from_this(), wasWriting)
+    );
+    LOG_INFO("TcpConnection::migrateInLoop [%s] fd=%d cpu %d -> %d \n",
+        name().c_str(), channel_.fd(), oldLoop->cpu(), newLoop->cpu());
+}
+
+void TcpConnection::attachInLoop(bool wasWriting)
+{
+    migrating_ = false;
+    if (state_ == kConnected || state_ == kDisconnecting)
+    {
+        if (reading_)
+        {
+            channel_.enableReading();
+        }
+        if (wasWriting || outputBuffer_.readableBytes() > 0)
+        {
+            channel_.enableWriting();
+            touchTimeout(&writeEntry_, writeTimeout_);
+        }
+        touchTimeout(&idleEntry_, idleTimeout_);
+        touchTimeout(&readEntry_, readTimeout_);
+        scheduleBufferShrink();
+    }
+}
+
+void TcpConnection::setIdleTimeout(double seconds)
+{
+    idleTimeout_ = seconds;
+    if (state_ == kConnected)
+    {
+        touchTimeout(&idleEntry_, idleTimeout_);
+    }
+}
+
+void TcpConnection::setReadTimeout(double seconds)
+{
+    readTimeout_ = seconds;
+    if (state_ == kConnected)
+    {
+        touchTimeout(&readEntry_, readTimeout_);
+    }
+}
+
+void TcpConnection::setWriteTimeout(double seconds)
+{
+    writeTimeout_ = seconds;
+    if (state_ == kConnected && channel_.isWriting())
+    {
+        touchTimeout(&writeEntry_, writeTimeout_);
+    }
+}
+
+void TcpConnection::setEdgeTriggered(bool on, size_t budget)
+{
+    channel_.setEdgeTriggered(on);
+    eventByteBudget_ = budget > 0 ? budget : kDefaultEventByteBudget;
+}
+
+void TcpConnection::touchTimeout(TimingWheel::Entry *entry, double timeout)
+{
+    if (timeout > 0.0)
+    {
+        loop()->timingWheel()->touch(entry, timeout);
+    }
+    else if (entry->linked())
+    {
+        loop()->timingWheel()->remove(entry);
+    }
+}
+
+void TcpConnection::removeTimeouts()
+{
+    if (idleEntry_.linked() || readEntry_.linked() || writeEntry_.linked() || bufferEntry_.linked())
+    {
+        TimingWheel *wheel = loop()->timingWheel();
+        wheel->remove(&idleEntry_);
+        wheel->remove(&readEntry_);
+        wheel->remove(&writeEntry_);
+        wheel->remove(&bufferEntry_);
+    }
+}
+
+// 比最小的大小级别大的输入缓冲区，空闲以后可以缩小
+static const size_t kShrinkableCapacity = BufferPool::kMinClassSize;
+
+void TcpConnection::scheduleBufferShrink()
+{
+    // 数据读完的时候存储已经还给内存池了，只剩半个消息而存储很大的时候才需要缩小
+    if (inputBuffer_.capacity() > kShrinkableCapacity && inputBuffer_.readableBytes() > 0)
+    {
+        touchTimeout(&bufferEntry_, bufferShrinkIdle_);
+    }
+    else if (bufferEntry_.linked())
     {
-        socket_->shutdownWrite(); // 关闭写端
+        touchTimeout(&bufferEntry_, 0.0);
     }
 }
 
+size_t TcpConnection::bufferBytes()
+{
+    size_t staged = 0;
+    {
+        std::lock_guard<std::mutex> lock(stagingMutex_);
+        staged = stagingBuffer_.allocatedBytes();
+    }
+    return inputBuffer_.capacity() + outputBuffer_.allocatedBytes() + staged;
+}
+
+// 时间轮在连接自己的loop里触发，不需要跨线程
+void TcpConnection::handleTimeout(const char *what)
+{
+    LOG_INFO("TcpConnection::handleTimeout [%s] %s timeout, force close \n", name().c_str(), what);
+    forceCloseInLoop();
+}
+
 // 连接建立
 void TcpConnection::connectEstablished()
 {
     setState(kConnected);
+    loop()->addConnections(1);
+    counted_ = true;
     // 在channel中绑定当前TcpConnection对象
-    channel_->tie(shared_from_this());
-    channel_->enableReading(); // 向poller注册channel的epollin事件
+    channel_.tie(shared_from_this());
+
+    if (completionIoRequested_)
+    {
+        IoUringPoller *poller = loop()->ioUringPoller();
+        if (poller && poller->supportsCompletionIo())
+        {
+            completionIo_ = true;
+            ioUring_ = poller;
+            recvOp_.reset(new IoUringOp);
+            recvOp_->callback = std::bind(&TcpConnection::handleRecvCompletion, this,
+                std::placeholders::_1, std::placeholders::_2);
+            sendOp_.reset(new IoUringSendOp);
+            sendOp_->callback = std::bind(&TcpConnection::handleSendCompletion, this,
+                std::placeholders::_1);
+        }
+    }
+
+    if (completionIo_)
+    {
+        startRecv(); // 不注册读事件，直接提交multishot recv
+    }
+    else
+    {
+        channel_.enableReading(); // 向poller注册channel的epollin事件
+    }
+    touchTimeout(&idleEntry_, idleTimeout_);
+    touchTimeout(&readEntry_, readTimeout_);
 
     // 新连接建立，执行回调
     connectionCallback_(shared_from_this());
@@ -180,24 +600,42 @@ void TcpConnection::connectEstablished()
 // 连接销毁
 void TcpConnection::connectDestoryed()
 {
+    if (migrating_ || !loop()->isInLoopThread())
+    {
+        // 投递的时候连接还在旧loop，迁移以后转发到新loop处理
+        queueInOwnerLoop(std::bind(&TcpConnection::connectDestoryed, this));
+        return;
+    }
     if (state_ == kConnected)
     {
         setState(kDisconnected);
-        channel_->disableAll(); // 把channel的所有感兴趣的事件从poller中del掉
+        channel_.disableAll(); // 把channel的所有感兴趣的事件从poller中del掉
         connectionCallback_(shared_from_this());
     }
-    channel_->remove();  //把channel从poller中删除掉
+    uncountFromLoop();
+    removeTimeouts();
+    channel_.remove();  //把channel从poller中删除掉
 }
 
 void TcpConnection::handleRead(Timestamp receiveTime)
 {
+    if (channel_.isEdgeTriggered())
+    {
+        handleReadEdgeTriggered(receiveTime);
+        return;
+    }
+
     int savedErrno = 0;
-    ssize_t n = inputBuffer_.readFd(channel_->fd(), &savedErrno);
+    ssize_t n = inputBuffer_.readFd(channel_.fd(), &savedErrno);
     if (n > 0)
     {
+        addTraffic(n);
+        // 收到数据只是把时间轮上的节点挪个桶
+        touchTimeout(&idleEntry_, idleTimeout_);
+        touchTimeout(&readEntry_, readTimeout_);
         // 已建立连接的用户，有可读事件发生了，调用用户传入的回调操作onMessage
         messageCallback_(shared_from_this(), &inputBuffer_, receiveTime);
-
+        scheduleBufferShrink();
     }
     else if (n == 0)
     {
@@ -212,20 +650,29 @@ void TcpConnection::handleRead(Timestamp receiveTime)
 
 void TcpConnection::handleWrite()
 {
-    if (channel_->isWriting())
+    if (channel_.isEdgeTriggered())
+    {
+        handleWriteEdgeTriggered();
+        return;
+    }
+
+    if (channel_.isWriting())
     {
         int savedErrno = 0;
-        ssize_t n = outputBuffer_.writeFd(channel_->fd(), &savedErrno);
+        ssize_t n = outputBuffer_.writeFd(channel_.fd(), &savedErrno);
         if (n > 0)
         {
             outputBuffer_.retrieve(n); 
+            addTraffic(n);
+            touchTimeout(&idleEntry_, idleTimeout_);
             if (outputBuffer_.readableBytes() == 0) // 表示可读缓冲区的数据都发送完成了
             {
-                channel_->disableWriting();
+                channel_.disableWriting();
+                touchTimeout(&writeEntry_, 0.0);
                 if (writeCompleteCallback_)
                 {
                     // 唤醒loop_对应的thread线程，执行回调
-                    loop_->queueInLoop(
+                    queueInOwnerLoop(
                         std::bind(writeCompleteCallback_,shared_from_this())
                     );
                 }
@@ -235,6 +682,10 @@ void TcpConnection::handleWrite()
                 }
 
             }
+            else
+            {
+                touchTimeout(&writeEntry_, writeTimeout_); // 有进展，刷新写超时
+            }
         }
         else
         {
@@ -243,16 +694,158 @@ void TcpConnection::handleWrite()
     }
     else
     {
-        LOG_ERROR("TcpConnection fd=%d is down, no more writing \n", channel_->fd());
+        LOG_ERROR("TcpConnection fd=%d is down, no more writing \n", channel_.fd());
+    }
+}
+
+void TcpConnection::handleReadEdgeTriggered(Timestamp receiveTime)
+{
+    if (state_ == kDisconnected)
+    {
+        return; // 排队的续读执行之前连接已经关闭了
+    }
+
+    // 边沿触发只通知一次，要一直读到EAGAIN，否则剩下的数据不会再有事件
+    size_t total = 0;
+    bool peerClosed = false;
+    bool budgetExhausted = false;
+    for (;;)
+    {
+        int savedErrno = 0;
+        ssize_t n = inputBuffer_.readFd(channel_.fd(), &savedErrno);
+        if (n > 0)
+        {
+            addTraffic(n);
+            total += n;
+            if (total >= eventByteBudget_)
+            {
+                budgetExhausted = true;
+                break;
+            }
+        }
+        else if (n == 0)
+        {
+            peerClosed = true;
+            break;
+        }
+        else if (savedErrno == EAGAIN || savedErrno == EWOULDBLOCK)
+        {
+            break;
+        }
+        else if (savedErrno != EINTR)
+        {
+            errno = savedErrno;
+            LOG_ERROR("TcpConnection::handleReadEdgeTriggered");
+            handleError();
+            peerClosed = true; // 出错以后socket已经不可用了，当成对端关闭处理
+            break;
+        }
+    }
+
+    if (total > 0)
+    {
+        touchTimeout(&idleEntry_, idleTimeout_);
+        touchTimeout(&readEntry_, readTimeout_);
+        messageCallback_(shared_from_this(), &inputBuffer_, receiveTime);
+        scheduleBufferShrink();
+    }
+    if (peerClosed)
+    {
+        handleClose();
+    }
+    else if (budgetExhausted && (state_ == kConnected || state_ == kDisconnecting))
+    {
+        // 预算用完了，socket里可能还有数据，但是不会再有新的边沿，自己排到下一轮继续读
+        queueInOwnerLoop(
+            std::bind(&TcpConnection::handleRead, shared_from_this(), receiveTime)
+        );
+    }
+}
+
+void TcpConnection::handleWriteEdgeTriggered()
+{
+    if (!channel_.isWriting())
+    {
+        return; // 排队的续写执行之前数据已经发完了
+    }
+
+    size_t total = 0;
+    bool budgetExhausted = false;
+    while (outputBuffer_.readableBytes() > 0)
+    {
+        int savedErrno = 0;
+        ssize_t n = outputBuffer_.writeFd(channel_.fd(), &savedErrno);
+        if (n > 0)
+        {
+            outputBuffer_.retrieve(n);
+            addTraffic(n);
+            total += n;
+            if (total >= eventByteBudget_ && outputBuffer_.readableBytes() > 0)
+            {
+                budgetExhausted = true;
+                break;
+            }
+        }
+        else if (savedErrno == EAGAIN || savedErrno == EWOULDBLOCK)
+        {
+            break; // 等下一个EPOLLOUT边沿
+        }
+        else if (savedErrno != EINTR)
+        {
+            errno = savedErrno;
+            LOG_ERROR("TcpConnection::handleWriteEdgeTriggered");
+            break;
+        }
+    }
+
+    if (total > 0)
+    {
+        touchTimeout(&idleEntry_, idleTimeout_);
+    }
+    if (outputBuffer_.readableBytes() == 0)
+    {
+        channel_.disableWriting();
+        touchTimeout(&writeEntry_, 0.0);
+        if (writeCompleteCallback_)
+        {
+            queueInOwnerLoop(
+                std::bind(writeCompleteCallback_, shared_from_this())
+            );
+        }
+        if (state_ == kDisconnecting)
+        {
+            shutdownInLoop();
+        }
+    }
+    else
+    {
+        if (total > 0)
+        {
+            touchTimeout(&writeEntry_, writeTimeout_);
+        }
+        if (budgetExhausted)
+        {
+            queueInOwnerLoop(
+                std::bind(&TcpConnection::handleWrite, shared_from_this())
+            );
+        }
     }
 }
 
 // poller => channel::closeCallback => TcpConnection::handleClose
 void TcpConnection::handleClose()
 {
-    LOG_INFO("TcpConnection::handleClose fd=%d state=%d \n", channel_->fd(), (int)state_);
+    LOG_DEBUG("TcpConnection::handleClose fd=%d state=%d \n", channel_.fd(), (int)state_);
     setState(kDisconnected);
-    channel_->disableAll();
+    channel_.disableAll();
+    uncountFromLoop();
+    removeTimeouts();
+    if (completionIo_)
+    {
+        // 请求被取消以后才会释放guard，在那之前socket不会被关闭
+        ioUring_->cancel(recvOp_.get());
+        ioUring_->cancel(sendOp_.get());
+    }
 
     TcpConnectionPtr connPtr(shared_from_this());
     connectionCallback_(connPtr); // 执行连接变化的回调
@@ -264,12 +857,117 @@ void TcpConnection::handleError()
     int optval;
     socklen_t optlen = sizeof optval;
     int err = 0;
-    if (::getsockopt(channel_->fd(), SOL_SOCKET, SO_ERROR, &optval, &optlen) < 0)
+    if (::getsockopt(channel_.fd(), SOL_SOCKET, SO_ERROR, &optval, &optlen) < 0)
     {
         err = errno;
     }
     else{
         err = optval;
     }
-    LOG_ERROR("TcpConnection::handleError name:%s - SO_ERROR:%d \n",name_.c_str(),err);
+    LOG_ERROR("TcpConnection::handleError name:%s - SO_ERROR:%d \n",name().c_str(),err);
+}
+
+void TcpConnection::startRecv()
+{
+    ioUring_->submitRecv(channel_.fd(), recvOp_.get(), shared_from_this());
+}
+
+void TcpConnection::handleRecvCompletion(int res, uint32_t flags)
+{
+    if (res > 0)
+    {
+        // 数据已经在注册的缓冲区里了，拷进inputBuffer_以后马上还给内核
+        uint16_t bid = static_cast<uint16_t>(flags >> IORING_CQE_BUFFER_SHIFT);
+        inputBuffer_.append(ioUring_->bufferData(bid), res);
+        ioUring_->recycleBuffer(bid);
+        addTraffic(res);
+
+        touchTimeout(&idleEntry_, idleTimeout_);
+        touchTimeout(&readEntry_, readTimeout_);
+        messageCallback_(shared_from_this(), &inputBuffer_, loop()->pollReturnTime());
+        scheduleBufferShrink();
+    }
+    else if (res == 0)
+    {
+        handleClose();
+        return;
+    }
+    else if (res == -ECANCELED)
+    {
+        return;
+    }
+    else if (res != -ENOBUFS) // ENOBUFS表示缓冲区环暂时用完了，重新提交即可
+    {
+        errno = -res;
+        LOG_ERROR("TcpConnection::handleRecvCompletion fd=%d err:%d \n", channel_.fd(), -res);
+        handleClose();
+        return;
+    }
+
+    // multishot recv结束了(缓冲区用完或者内核主动结束)，连接还在就重新提交
+    if (!(flags & IORING_CQE_F_MORE) && !recvOp_->inflight
+        && (state_ == kConnected || state_ == kDisconnecting))
+    {
+        startRecv();
+    }
+}
+
+void TcpConnection::startSend()
+{
+    int iovcnt = outputBuffer_.fillIovec(sendOp_->iov, IoUringSendOp::kMaxIov);
+    if (iovcnt == 0)
+    {
+        return;
+    }
+    ioUring_->submitSendmsg(channel_.fd(), iovcnt, sendOp_.get(), shared_from_this());
+    if (!writeEntry_.linked())
+    {
+        touchTimeout(&writeEntry_, writeTimeout_);
+    }
+}
+
+void TcpConnection::handleSendCompletion(int res)
+{
+    if (res > 0)
+    {
+        outputBuffer_.retrieve(res);
+        addTraffic(res);
+        touchTimeout(&idleEntry_, idleTimeout_);
+        if (outputBuffer_.readableBytes() > 0)
+        {
+            if (state_ != kDisconnected)
+            {
+                touchTimeout(&writeEntry_, writeTimeout_); // 有进展，刷新写超时
+                startSend();
+            }
+        }
+        else
+        {
+            touchTimeout(&writeEntry_, 0.0);
+            if (writeCompleteCallback_)
+            {
+                queueInOwnerLoop(
+                    std::bind(writeCompleteCallback_, shared_from_this())
+                );
+            }
+            if (state_ == kDisconnecting)
+            {
+                shutdownInLoop();
+            }
+        }
+    }
+    else if (res == 0)
+    {
+        // 一个字节也没发出去，不是错误，数据还在就重新提交
+        if (outputBuffer_.readableBytes() > 0 && state_ != kDisconnected)
+        {
+            startSend();
+        }
+    }
+    else if (res != -ECANCELED)
+    {
+        // EPIPE/ECONNRESET之类的错误，连接关闭由recv的完成事件驱动
+        errno = -res;
+        LOG_ERROR("TcpConnection::handleSendCompletion fd=%d err:%d \n", channel_.fd(), -res);
+    }
 }
@@ -4,16 +4,24 @@
 #include "InetAddress.h"
 #include "Callbacks.h"
 #include "Buffer.h"
+#include "BufferChain.h"
+#include "StringPiece.h"
 #include "Timestamp.h"
+#include "TimingWheel.h"
+#include "Socket.h"
+#include "Channel.h"
 
 
 #include <memory>
 #include <string>
 #include <atomic>
+#include <mutex>
+#include <functional>
 
-class Channel;
 class EventLoop;
-class Socket;
+class IoUringPoller;
+struct IoUringOp;
+struct IoUringSendOp;
 
 /**
  * TcpServer =>Acceptor => 有一个新用户连接，通过accept函数得到connfd
@@ -28,22 +36,67 @@ private:
 
     void handleRead(Timestamp receiveTime);
     void handleWrite();
+    // 边沿触发模式下的读写，一直读/写到EAGAIN或者用完这一轮的字节预算
+    void handleReadEdgeTriggered(Timestamp receiveTime);
+    void handleWriteEdgeTriggered();
     void handleClose();
     void handleError();
 
-    void sendInLoop(const void* message, size_t len);
+    void sendInLoop(const StringPiece &header, const StringPiece &body);
     void shutdownInLoop();
-
-    EventLoop *loop_; // 这里绝对不是baseloop，因为TcpConnection都是在subLoop里面管理的
-    const std::string name_;
+    void forceCloseInLoop();
+
+    // 时间轮上的超时回调，what是超时的种类，用于打日志
+    void handleTimeout(const char *what);
+    // timeout>0时刷新entry的到期时间，否则把entry从时间轮上摘掉
+    void touchTimeout(TimingWheel::Entry *entry, double timeout);
+    void removeTimeouts();
+    void scheduleBufferShrink();
+
+    EventLoop* loop() const { return loop_.load(std::memory_order_acquire); }
+
+    // 在连接当前所属loop的线程里执行fn，连接正在迁移或者不在所属线程时投递过去
+    void runInOwnerLoop(const std::function<void()> &fn);
+    // 投递到连接当前所属的loop，执行时连接已经迁移走的话继续转发给新的loop
+    void queueInOwnerLoop(const std::function<void()> &fn);
+    // 把其它线程send进来暂存的数据交给sendInLoop
+    void flushStaged();
+    // 迁移的两步：在旧loop里摘下channel和定时器，在新loop里重新注册
+    void migrateInLoop(EventLoop *newLoop);
+    void attachInLoop(bool wasWriting);
+    // 记录读写的字节数，给loop的负载统计和重新均衡用
+    void addTraffic(size_t n);
+
+    // 完成模式(io_uring)的读写路径
+    void startRecv();
+    void handleRecvCompletion(int res, uint32_t flags);
+    void startSend();
+    void handleSendCompletion(int res);
+    // 在所属loop的线程里调用，连接断开时从loop的连接数里减掉，只减一次
+    void uncountFromLoop();
+
+    // 这里绝对不是baseloop，因为TcpConnection都是在subLoop里面管理的
+    // 连接可以在subloop之间迁移，其它线程通过getLoop读取
+    std::atomic<EventLoop*> loop_;
+    std::atomic_bool migrating_;  // 已经从旧loop摘下，还没有在新loop上注册
+    // 是否计入了所属loop的numConnections，connectEstablished时计入，变成kDisconnected时在所属loop里减掉，
+    // 用户或线程池任务还持有TcpConnectionPtr也不再算这个loop的连接，析构时不碰loop(loop可能已经析构)
+    bool counted_;
+    // 名字和本端地址第一次用到的时候才生成，建立连接的路径上不做字符串格式化和getsockname
+    const uint64_t id_;
+    const std::shared_ptr<const std::string> namePrefix_;
+    mutable std::once_flag nameOnce_;
+    mutable std::string name_;
     std::atomic_int state_;
     bool reading_;
 
     // 这里和Acceptor类似 Acceptor <= mainLoop 监听连接事件  TcpConnection<=subLoop 监听数据读写事件
-    std::unique_ptr<Socket> socket_;
-    std::unique_ptr<Channel> channel_;
+    // 直接嵌在连接对象里，和连接、shared_ptr的控制块一起分配(见TcpServer::createConnection)
+    Socket socket_;
+    Channel channel_;
 
-    const InetAddress localAddr_;  // 记录当前主机的ip地址端口号
+    mutable std::once_flag localAddrOnce_;
+    mutable InetAddress localAddr_;  // 记录当前主机的ip地址端口号
     const InetAddress peerAddr_;   // 记录客户端的ip地址端口号
 
     // 用户通过TcpServer提供的接口设置回调函数，Tcpserver=>TcpConnection=>Channel，poller监听channel,有时间发生就通过loop执行相应的回调函数
@@ -52,30 +105,100 @@ private:
     WriteCompleteCallback writeCompleteCallback_; // 消息发送完成以后的回调
     HighWaterMarkCallback highWaterMarkCallback_;
     CloseCallback closeCallback_;
+    MigrateCallback migrateCallback_;
     size_t highWaterMark_;
 
     Buffer inputBuffer_; // 接收数据的缓冲区
-    Buffer outputBuffer_; // 发送数据的缓冲区
+    BufferChain outputBuffer_; // 发送数据的缓冲区，分段存储，追加时不挪动已有数据
+
+    // 其它线程调用send时数据先追加到这里，再投递一次flushStaged，
+    // 多次跨线程send合并成一次投递，连接迁移以后也能保持发送顺序
+    std::mutex stagingMutex_;
+    BufferChain stagingBuffer_;
+    std::atomic_bool hasStaged_;
+
+    std::atomic<uint64_t> bytesTransferred_; // 只在所属loop线程里修改
+
+    // 挂在所属loop时间轮上的超时节点，单位秒，<=0表示不启用
+    double idleTimeout_;   // 既没有读也没有写
+    double readTimeout_;   // 没有收到数据
+    double writeTimeout_;  // 发送缓冲区有数据但是一直发不出去
+    TimingWheel::Entry idleEntry_;
+    TimingWheel::Entry readEntry_;
+    TimingWheel::Entry writeEntry_;
+    // 输入缓冲区里剩着数据而且存储偏大时挂上，bufferShrinkIdle_秒没有新数据就缩小存储
+    double bufferShrinkIdle_;
+    TimingWheel::Entry bufferEntry_;
+
+    // 完成模式：读由multishot recv把数据放进inputBuffer_，
+    // 写直接从outputBuffer_的前几个块提交sendmsg，追加数据不会挪动这些块，完成以后再retrieve
+    bool completionIoRequested_;
+    bool completionIo_;
+    IoUringPoller *ioUring_;
+    std::unique_ptr<IoUringOp> recvOp_;
+    std::unique_ptr<IoUringSendOp> sendOp_;
+
+    // 边沿触发模式下每次事件最多读/写的字节数，用完以后剩下的放到下一轮loop，避免一个连接饿死其它连接
+    size_t eventByteBudget_;
 
 public:
+    // 连接的名字是 *namePrefix + "#" + id，第一次调用name()的时候才拼出来
     TcpConnection(EventLoop *loop,
-                const std::string &nameArg,
+                const std::shared_ptr<const std::string> &namePrefix,
+                uint64_t id,
                 int sockfd,
-                const InetAddress& localAddr_,
                 const InetAddress& peerAddr_);
     ~TcpConnection();
 
-    EventLoop* getLoop() const { return loop_;}
-    const std::string& name() const { return name_; }
-    const InetAddress& localAddress() const { return localAddr_; }
+    EventLoop* getLoop() const { return loop(); }
+    uint64_t id() const { return id_; }
+    const std::string& name() const;
+    const InetAddress& localAddress() const;
     const InetAddress& peerAddress() const { return peerAddr_; }
     
     bool connected() const { return state_ == kConnected; }
 
-    // 发送数据
-    void send(const std::string &buf);
+    // 发送数据，std::string、字符串常量和Buffer::peekView()都可以直接传，不用先拷成std::string
+    // 在连接所属loop的线程里直接写socket或追加到发送缓冲区，返回以后message就可以释放或retrieve
+    void send(const StringPiece &message);
+    void send(const void *message, size_t len);
+    // header和body按顺序连成一条数据发送，两段不用先拼到同一块内存里(比如长度头和消息体)
+    void send(const StringPiece &header, const StringPiece &body);
     // 关闭连接
     void shutdown();
+    // 强制关闭连接，不等发送缓冲区的数据发完
+    void forceClose();
+
+    // 把连接迁移到newLoop，可以在任意线程调用，迁移在连接当前loop的下一轮回调里进行
+    // channel、输入输出缓冲区和超时定时器都随连接一起搬过去，迁移前后send的数据保持顺序
+    // 只迁移kConnected状态的连接，完成模式(io_uring)的连接不能迁移
+    void migrateTo(EventLoop *newLoop);
+    // 把cb投递到连接当前所属的loop里执行，可以在任意线程调用，连接正在迁移时会转发到新的loop
+    void queueInLoop(const std::function<void()> &cb) { queueInOwnerLoop(cb); }
+
+    // 连接累计读写的字节数，可以在任意线程读
+    uint64_t bytesTransferred() const { return bytesTransferred_.load(std::memory_order_relaxed); }
+    // 输入输出缓冲区当前占用的内存，只能在连接所属loop的线程里调用
+    size_t bufferBytes();
+
+    // 超时设置，单位秒，<=0表示关闭，超时以后在连接自己的loop里forceClose
+    // 连接建立之前可以在任意线程设置，建立以后只能在连接所属loop的线程里调用(比如连接回调里)
+    void setIdleTimeout(double seconds);
+    void setReadTimeout(double seconds);
+    void setWriteTimeout(double seconds);
+    // 输入缓冲区涨大以后只剩少量数据，空闲这么多秒以后缩小存储，<=0表示不缩小；需要在连接建立之前设置
+    void setBufferShrinkIdle(double seconds) { bufferShrinkIdle_ = seconds; }
+    static constexpr double kDefaultBufferShrinkIdle = 10.0;
+
+    // 使用io_uring完成模式读写，需要在连接建立之前设置
+    // loop的poller不是IoUringPoller或者内核不支持multishot recv时仍然走readv/write
+    void setCompletionIo(bool on) { completionIoRequested_ = on; }
+    bool completionIo() const { return completionIo_; }
+
+    // 边沿触发(EPOLLET)模式，需要在连接建立之前设置，适合大块数据传输的连接，减少epoll_wait的唤醒次数
+    // budget是每次事件最多读/写的字节数，超过以后通过queueInLoop在下一轮继续
+    void setEdgeTriggered(bool on, size_t budget = kDefaultEventByteBudget);
+    static const size_t kDefaultEventByteBudget = 256 * 1024;
 
     void setConnectionCallback(const ConnectionCallback& cb) 
     {
@@ -97,6 +220,12 @@ public:
         highWaterMark_ = highWaterMark;
     }
 
+    // 迁移开始时在旧loop里调用(连接已经从旧loop摘下)，TcpServer用来把连接从旧loop的连接表挪到新loop的连接表
+    void setMigrateCallback(const MigrateCallback& cb)
+    {
+        migrateCallback_ = cb;
+    }
+
     void setCloseCallback(const CloseCallback& cb)
     {
         closeCallback_ = cb;
@@ -2,11 +2,13 @@
 #include "Logger.h"
 // #include "EventLoopThreadPool.h"
 #include "TcpConnection.h"
+#include "FixedSizePool.h"
+#include "BufferPool.h"
 
 #include <strings.h>
 #include <functional>
-
-#include <functional>
+#include <algorithm>
+#include <future>
 
 static EventLoop* CheckLoopNotNull(EventLoop *loop)
 {
@@ -24,34 +26,95 @@ TcpServer::TcpServer(EventLoop *loop,
                 : loop_(CheckLoopNotNull(loop))
                 , ipPort_(listenAddr.toIpPort())
                 , name_(nameArg)
-                , acceptor_(new Acceptor(loop, listenAddr, option == kReusePort))
+                , connNamePrefix_(std::make_shared<std::string>(nameArg + "-" + ipPort_))
+                , listenAddr_(listenAddr)
+                , option_(option)
+                , numAccepted_(0)
+                , numDropped_(0)
                 , threadPool_(new EventLoopThreadPool(loop, name_))
                 , connectionCallback_()
                 , messageCallback_()
                 , nextConnId_(1)
                 , started_(0)
+                , idleTimeout_(0.0)
+                , bufferShrinkIdle_(TcpConnection::kDefaultBufferShrinkIdle)
+                , completionIo_(false)
+                , edgeTriggered_(false)
+                , incomingCpuSteering_(false)
+                , eventByteBudget_(TcpConnection::kDefaultEventByteBudget)
+                , acceptBatch_(Acceptor::kDefaultAcceptBatch)
+                , rebalanceInterval_(0.0)
+                , rebalanceRatio_(1.5)
+                , rebalanceMaxMoves_(1)
+                , numMigrations_(0)
+                , drainMigrates_(true)
 {
-    // 当有新用户连接时，会执行TcpServer::newConnection回调
-    acceptor_->setNewConnectionCallback(std::bind(&TcpServer::newConnection, this,
-        std::placeholders::_1, std::placeholders::_2));
+    if (option_ == kNoReusePort || option_ == kReusePort)
+    {
+        acceptor_.reset(new Acceptor(loop, listenAddr, option_ == kReusePort));
+        // 当有新用户连接时，会执行TcpServer::newConnection回调
+        acceptor_->setNewConnectionCallback(std::bind(&TcpServer::newConnection, this,
+            std::placeholders::_1, std::placeholders::_2));
+        acceptor_->setTotals(&numAccepted_, &numDropped_);
+    }
+}
+
+// 在loop的线程里执行cb，等它执行完再返回；已经在loop的线程里就直接执行
+// 别的线程调用时loop必须还在运行，否则会一直等下去
+static void runInLoopAndWait(EventLoop *loop, const std::function<void()> &cb)
+{
+    if (loop->isInLoopThread())
+    {
+        cb();
+        return;
+    }
+    std::shared_ptr<std::promise<void>> done(new std::promise<void>);
+    std::future<void> finished = done->get_future();
+    loop->runInLoop([cb, done]() {
+        cb();
+        done->set_value();
+    });
+    finished.wait();
 }
 
 TcpServer::~TcpServer()
 {
-    for (auto &item : connections_)
+    // 下面要在baseLoop里注销Acceptor、摘掉连接表，loop()返回以后在别的线程析构会永远等不到
+    if (!loop_->isInLoopThread())
     {
-        // 这个局部的share_ptr智能指针对象，出右括号，可以自动释放new出来的TcpConnection对象资源
-        TcpConnectionPtr conn(item.second);
-        item.second.reset();
+        LOG_FATAL("%s:%s:%d TcpServer %s must be destroyed in its loop thread \n",
+            __FILE__, __FUNCTION__, __LINE__, name_.c_str());
+    }
+    if (rebalanceTimer_.valid())
+    {
+        loop_->cancel(rebalanceTimer_);
+    }
+    if (retireTimer_.valid())
+    {
+        loop_->cancel(retireTimer_);
+    }
+    stopLoopAcceptors();
 
-        // 销毁连接
-        conn->getLoop()->runInLoop(
-            std::bind(&TcpConnection::connectDestoryed, conn)
-        );
+    // 每个loop在自己的线程里销毁自己的连接，再把连接表从loop上摘掉
+    for (EventLoop *ioLoop : serverLoops())
+    {
+        runInLoopAndWait(ioLoop, [this, ioLoop]() {
+            ConnectionShard *shard = shardOf(ioLoop);
+            if (shard == nullptr)
+            {
+                return;
+            }
+            ConnectionMap connections;
+            connections.swap(shard->connections);
+            for (auto &conn : connections)
+            {
+                conn.second->connectDestoryed();
+            }
+            ioLoop->removeContext(this);
+        });
     }
 }
 
-
 // 设置底层subloop的个数
 void TcpServer::setThreadNum(int numThreads)
 {
@@ -64,73 +127,477 @@ void TcpServer::start()
     if (started_++ == 0) // 防止一个TcpServer对象被start多次
     {
         threadPool_->start(threadInitCallback_); // 启动底层的loop线程池
-        loop_->runInLoop(std::bind(&Acceptor::listen, acceptor_.get()));
+        for (EventLoop *ioLoop : serverLoops())
+        {
+            createShard(ioLoop);
+        }
+        if (acceptor_)
+        {
+            loop_->runInLoop(std::bind(&Acceptor::listen, acceptor_.get()));
+        }
+        else
+        {
+            updateLoopAcceptors();
+        }
+        if (rebalanceInterval_ > 0.0)
+        {
+            rebalanceTimer_ = loop_->runEvery(rebalanceInterval_, std::bind(&TcpServer::rebalance, this));
+        }
+    }
+}
+
+void TcpServer::updateLoopAcceptors()
+{
+    std::vector<EventLoop*> loops = threadPool_->getAllLoops();
+    // 先给新的loop建Acceptor，共享监听socket的方式从还在的Acceptor上dup
+    for (EventLoop *ioLoop : loops)
+    {
+        bool found = std::any_of(loopAcceptors_.begin(), loopAcceptors_.end(),
+            [ioLoop](const std::unique_ptr<Acceptor> &acceptor) { return acceptor->getLoop() == ioLoop; });
+        if (found)
+        {
+            continue;
+        }
+        Acceptor *acceptor = nullptr;
+        if (option_ == kExclusiveListener && !loopAcceptors_.empty())
+        {
+            acceptor = new Acceptor(ioLoop, *loopAcceptors_.front());
+        }
+        else
+        {
+            acceptor = new Acceptor(ioLoop, listenAddr_, option_ == kReusePortPerLoop);
+            acceptor->setExclusive(option_ == kExclusiveListener);
+            acceptor->setAcceptBatch(acceptBatch_);
+        }
+        acceptor->setNewConnectionCallback(std::bind(&TcpServer::createConnection, this, ioLoop,
+            std::placeholders::_1, std::placeholders::_2));
+        acceptor->setTotals(&numAccepted_, &numDropped_);
+        loopAcceptors_.emplace_back(acceptor);
+        ioLoop->runInLoop(std::bind(&Acceptor::listen, acceptor));
+    }
+
+    // 再关掉不再分配新连接的loop上的Acceptor
+    for (auto it = loopAcceptors_.begin(); it != loopAcceptors_.end(); )
+    {
+        if (std::find(loops.begin(), loops.end(), (*it)->getLoop()) == loops.end())
+        {
+            Acceptor *raw = it->release();
+            if (raw->getLoop()->isInLoopThread())
+            {
+                // 在baseLoop上调整(0个subloop时Acceptor就在baseLoop上)，这一轮的活跃channel里可能还有它的监听channel，
+                // 析构放到这一轮的回调里；在那之前accept到的连接直接关掉，不再交给TcpServer
+                raw->setNewConnectionCallback(Acceptor::NewConnectionCallback());
+                raw->getLoop()->queueInLoop([raw]() { delete raw; });
+            }
+            else
+            {
+                runInLoopAndWait(raw->getLoop(), [raw]() { delete raw; });
+            }
+            it = loopAcceptors_.erase(it);
+        }
+        else
+        {
+            ++it;
+        }
+    }
+}
+
+// Acceptor的channel要在自己的loop里注销，等它完成以后再返回，之后不会再有回调进入TcpServer
+void TcpServer::stopLoopAcceptors()
+{
+    for (auto &acceptor : loopAcceptors_)
+    {
+        Acceptor *raw = acceptor.release();
+        runInLoopAndWait(raw->getLoop(), [raw]() { delete raw; });
+    }
+    loopAcceptors_.clear();
+}
+
+TcpServer::ConnectionShard* TcpServer::shardOf(EventLoop *loop) const
+{
+    return static_cast<ConnectionShard*>(loop->getContext(this));
+}
+
+void TcpServer::createShard(EventLoop *loop)
+{
+    loop->runInLoop([this, loop]() { loop->setContext(this, std::make_shared<ConnectionShard>()); });
+}
+
+std::vector<EventLoop*> TcpServer::serverLoops() const
+{
+    std::vector<EventLoop*> loops(1, loop_);
+    if (threadPool_->started())
+    {
+        for (EventLoop *ioLoop : threadPool_->getAllLoops())
+        {
+            if (ioLoop != loop_)
+            {
+                loops.push_back(ioLoop);
+            }
+        }
+        for (EventLoop *ioLoop : threadPool_->getRetiredLoops())
+        {
+            loops.push_back(ioLoop);
+        }
+    }
+    return loops;
+}
+
+void TcpServer::forEachConnection(const std::function<void(const TcpConnectionPtr&)> &cb)
+{
+    // loop的列表可能在运行时调整，只在baseLoop里读
+    loop_->runInLoop([this, cb]() {
+        for (EventLoop *ioLoop : serverLoops())
+        {
+            ioLoop->runInLoop([this, ioLoop, cb]() {
+                ConnectionShard *shard = shardOf(ioLoop);
+                if (shard == nullptr)
+                {
+                    return;
+                }
+                for (auto &conn : shard->connections)
+                {
+                    cb(conn.second);
+                }
+            });
+        }
+    });
+}
+
+void TcpServer::broadcast(const std::string &message)
+{
+    forEachConnection([message](const TcpConnectionPtr &conn) { conn->send(message); });
+}
+
+std::string TcpServer::memoryReport()
+{
+    std::string report;
+    size_t totalConnections = 0;
+    size_t totalBytes = 0;
+    char line[256];
+    for (EventLoop *ioLoop : serverLoops())
+    {
+        runInLoopAndWait(ioLoop, [&]() {
+            ConnectionShard *shard = shardOf(ioLoop);
+            size_t connections = 0;
+            size_t bufferBytes = 0;
+            if (shard != nullptr)
+            {
+                connections = shard->connections.size();
+                for (auto &item : shard->connections)
+                {
+                    bufferBytes += item.second->bufferBytes();
+                }
+            }
+            // 连接池和内存池是整个loop/线程的，baseLoop被多个服务器共享时包含别的服务器的连接
+            const std::shared_ptr<FixedSizePool> &pool = ioLoop->connectionPool();
+            size_t objectBytes = pool->numInUse() * pool->blockSize();
+            BufferPool::Stats stats = BufferPool::stats();
+            snprintf(line, sizeof line,
+                "  loop %p cpu=%d: %zu connections, objects %zuKB (pool %zuKB), buffers %zuKB, buffer pool cached %zuKB, hit %.1f%%\n",
+                ioLoop, ioLoop->cpu(), connections, objectBytes / 1024,
+                pool->numBlocks() * pool->blockSize() / 1024, bufferBytes / 1024, stats.bytesCached / 1024,
+                stats.allocations > 0 ? 100.0 * stats.cacheHits / stats.allocations : 0.0);
+            report += line;
+            totalConnections += connections;
+            totalBytes += objectBytes + bufferBytes;
+        });
+    }
+    snprintf(line, sizeof line, "TcpServer [%s] memory: %zu connections, %zu bytes/connection (objects + buffers)\n",
+        name_.c_str(), totalConnections, totalConnections > 0 ? totalBytes / totalConnections : 0);
+    return line + report;
+}
+
+void TcpServer::setAcceptBatch(int batch)
+{
+    acceptBatch_ = batch;
+    if (acceptor_)
+    {
+        acceptor_->setAcceptBatch(batch);
+    }
+}
+
+uint64_t TcpServer::numAccepted() const
+{
+    return numAccepted_.load(std::memory_order_relaxed);
+}
+
+uint64_t TcpServer::numDropped() const
+{
+    return numDropped_.load(std::memory_order_relaxed);
+}
+
+void TcpServer::resizeThreadPool(int numThreads, bool migrateConnections)
+{
+    loop_->runInLoop(std::bind(&TcpServer::resizeThreadPoolInLoop, this,
+        std::max(numThreads, 0), migrateConnections));
+}
+
+// 退役loop的检查间隔，秒
+static const double kRetireCheckInterval = 1.0;
+
+void TcpServer::resizeThreadPoolInLoop(int numThreads, bool migrateConnections)
+{
+    std::vector<EventLoop*> retired;
+    while (threadPool_->numThreads() < numThreads)
+    {
+        createShard(threadPool_->addLoop());
+    }
+    while (threadPool_->numThreads() > numThreads)
+    {
+        retired.push_back(threadPool_->retireLoop());
+    }
+    if (!acceptor_)
+    {
+        updateLoopAcceptors();
+    }
+    LOG_INFO("TcpServer::resizeThreadPool [%s] - %d subloops, %d retiring \n", name_.c_str(),
+        threadPool_->numThreads(), static_cast<int>(threadPool_->getRetiredLoops().size()));
+    if (retired.empty())
+    {
+        return;
+    }
+
+    drainMigrates_ = migrateConnections;
+    if (migrateConnections)
+    {
+        std::vector<EventLoop*> targets = threadPool_->getAllLoops();
+        for (EventLoop *ioLoop : retired)
+        {
+            ioLoop->runInLoop(std::bind(&TcpServer::drainLoop, this, ioLoop, targets));
+        }
+    }
+    if (!retireTimer_.valid())
+    {
+        retireTimer_ = loop_->runEvery(kRetireCheckInterval, std::bind(&TcpServer::checkRetiredLoops, this));
+    }
+}
+
+void TcpServer::drainLoop(EventLoop *retired, const std::vector<EventLoop*> &targets)
+{
+    ConnectionShard *shard = shardOf(retired);
+    if (shard == nullptr || targets.empty())
+    {
+        return;
+    }
+    // migrateTo在这一轮的回调里才真正迁移，遍历期间连接表不会变
+    size_t next = 0;
+    for (auto &item : shard->connections)
+    {
+        const TcpConnectionPtr &conn = item.second;
+        if (conn->connected() && !conn->completionIo())
+        {
+            conn->migrateTo(targets[next++ % targets.size()]);
+        }
+    }
+}
+
+void TcpServer::checkRetiredLoops()
+{
+    // 退役之前已经交给这个loop的新连接，下一次检查时再迁走
+    if (drainMigrates_)
+    {
+        std::vector<EventLoop*> targets = threadPool_->getAllLoops();
+        for (EventLoop *ioLoop : threadPool_->getRetiredLoops())
+        {
+            if (ioLoop->numConnections() > 0)
+            {
+                ioLoop->runInLoop(std::bind(&TcpServer::drainLoop, this, ioLoop, targets));
+            }
+        }
+    }
+    if (threadPool_->reapRetiredLoops() == 0)
+    {
+        loop_->cancel(retireTimer_);
+        retireTimer_ = TimerId();
+    }
+}
+
+void TcpServer::enableRebalancer(double intervalSec, double ratio, int maxMoves)
+{
+    rebalanceInterval_ = intervalSec;
+    rebalanceRatio_ = ratio > 1.0 ? ratio : 1.0;
+    rebalanceMaxMoves_ = maxMoves > 0 ? maxMoves : 1;
+}
+
+// 两个loop的loadScore差距小于这个值时不迁移，空闲的loop之间只有几微秒的抖动
+static const int64_t kRebalanceMinGap = 100;
+
+void TcpServer::rebalance()
+{
+    std::vector<EventLoop*> loops = threadPool_->getAllLoops();
+    EventLoop *hot = loops[0];
+    EventLoop *cold = loops[0];
+    for (EventLoop *loop : loops)
+    {
+        if (loop->loadScore() > hot->loadScore())
+        {
+            hot = loop;
+        }
+        if (loop->loadScore() < cold->loadScore())
+        {
+            cold = loop;
+        }
+    }
+
+    int64_t hotScore = hot->loadScore();
+    int64_t coldScore = cold->loadScore();
+    int64_t gap = hotScore - coldScore;
+    if (hot == cold
+        || hot->numConnections() < 2
+        || gap < kRebalanceMinGap
+        || hotScore < rebalanceRatio_ * std::max<int64_t>(coldScore, 1))
+    {
+        return;
+    }
+    hot->runInLoop(std::bind(&TcpServer::rebalanceInLoop, this, hot, cold, gap));
+}
+
+void TcpServer::rebalanceInLoop(EventLoop *hot, EventLoop *cold, int64_t gap)
+{
+    ConnectionShard *shard = shardOf(hot);
+    Timestamp now(Timestamp::now());
+    double seconds = shard->lastSample.valid()
+        ? timeDifference(now, shard->lastSample) : rebalanceInterval_;
+    shard->lastSample = now;
+
+    // 连接的负载用上次采样以来的流量估计
+    std::unordered_map<uint64_t, uint64_t> samples;
+    samples.reserve(shard->connections.size());
+    std::vector<std::pair<uint64_t, TcpConnectionPtr>> candidates;
+    for (auto &item : shard->connections)
+    {
+        uint64_t bytes = item.second->bytesTransferred();
+        auto it = shard->trafficSamples.find(item.first);
+        uint64_t delta = it == shard->trafficSamples.end() ? bytes : bytes - it->second;
+        samples[item.first] = bytes;
+        if (item.second->connected())
+        {
+            candidates.emplace_back(delta, item.second);
+        }
+    }
+    shard->trafficSamples.swap(samples);
+    if (candidates.size() < 2)
+    {
+        return;
+    }
+
+    // 连接的分数：流量按loadScore的口径折算，再平摊loop的延迟；从最忙的连接开始挑，
+    // 搬走一个分数为s的连接两边的差距缩小2s，超过差距一半的连接搬过去只会让对面变成最忙的
+    std::sort(candidates.begin(), candidates.end(),
+        [](const std::pair<uint64_t, TcpConnectionPtr> &a, const std::pair<uint64_t, TcpConnectionPtr> &b)
+        { return a.first > b.first; });
+    int64_t lagShare = hot->loopLagUs() / static_cast<int64_t>(candidates.size());
+    int moves = 0;
+    for (auto &candidate : candidates)
+    {
+        if (moves >= rebalanceMaxMoves_)
+        {
+            break;
+        }
+        int64_t score = static_cast<int64_t>(candidate.first / seconds / 65536) + lagShare;
+        if (score * 2 > gap)
+        {
+            continue;
+        }
+        LOG_INFO("TcpServer::rebalance [%s] - migrate %s, loop score gap %ld \n", name_.c_str(),
+            candidate.second->name().c_str(), static_cast<long>(gap));
+        candidate.second->migrateTo(cold);
+        gap -= score * 2;
+        ++moves;
+        ++numMigrations_;
     }
 }
 
-// 每当有一个新的客户端的连接，acceptor会执行这个回调操作
 void TcpServer::newConnection(int sockfd, const InetAddress &peerAddr)
 {
     // 轮询算法，选择一个subLoop, 来管理channel
-    EventLoop *ioLoop = threadPool_->getNextLoop();
-    char buf[64] = {0};
-    snprintf(buf, sizeof buf, "-%s#%d", ipPort_.c_str(), nextConnId_);
-    ++nextConnId_;
-    std::string connName = name_ + buf;
-
-    LOG_INFO("TcpServer::newConnection [%s] - new connection [%s] from %s \n",
-        name_.c_str(), connName.c_str(), peerAddr.toIpPort().c_str());
-    
-    // 通过sockefd获取其绑定的本机的ip地址和端口信息
-    sockaddr_in local;
-    ::bzero(&local, sizeof local);
-    socklen_t addrlen = sizeof local;
-    if (::getsockname(sockfd, (sockaddr*)&local, &addrlen) < 0)
-    {
-        LOG_ERROR("sockets::getLocalAddr");
-    }
-    InetAddress localAddr(local);
-
-    // 根据连接成功的sockfd，创建TcpConnection连接对象
-    TcpConnectionPtr conn(new TcpConnection(
+    EventLoop *ioLoop = nullptr;
+    if (incomingCpuSteering_)
+    {
+        int cpu = -1;
+        socklen_t len = sizeof cpu;
+        if (::getsockopt(sockfd, SOL_SOCKET, SO_INCOMING_CPU, &cpu, &len) == 0)
+        {
+            ioLoop = threadPool_->getLoopForCpu(cpu);
+        }
+    }
+    if (ioLoop == nullptr)
+    {
+        ioLoop = threadPool_->getLoopForConnection(peerAddr);
+    }
+    ioLoop->runInLoop(std::bind(&TcpServer::createConnection, this, ioLoop, sockfd, peerAddr));
+}
+
+void TcpServer::createConnection(EventLoop *ioLoop, int sockfd, const InetAddress &peerAddr)
+{
+    // 根据连接成功的sockfd，创建TcpConnection连接对象，名字和本端地址用到的时候才生成
+    // 连接(内嵌Socket和Channel)和shared_ptr的控制块一起从ioLoop的内存池里分配
+    TcpConnectionPtr conn = std::allocate_shared<TcpConnection>(
+                            PoolAllocator<TcpConnection>(ioLoop->connectionPool()),
                             ioLoop,
-                            connName,
+                            connNamePrefix_,
+                            nextConnId_++,
                             sockfd,  // Socket Channel
-                            localAddr,
-                            peerAddr));
-    connections_[connName] = conn;
+                            peerAddr);
+    LOG_DEBUG("TcpServer::newConnection [%s] - new connection [%s] from %s \n",
+        name_.c_str(), conn->name().c_str(), peerAddr.toIpPort().c_str());
 
     // 下面的回调都是用户设置给TcpServer=>TcpConnection=>Channel=>Poller=>notify channel调用回调
     conn->setConnectionCallback(connectionCallback_);
     conn->setMessageCallback(messageCallback_);
     conn->setWriteCompleteCallback(writeCompleteCallback_);
+    conn->setIdleTimeout(idleTimeout_);
+    conn->setBufferShrinkIdle(bufferShrinkIdle_);
+    conn->setCompletionIo(completionIo_);
+    conn->setEdgeTriggered(edgeTriggered_, eventByteBudget_);
 
     // 设置了如何关闭连接的回调 conn->shutdown()
+    // 只捕获this，不需要给std::function单独分配内存
     conn->setCloseCallback(
-        std::bind(&TcpServer::removeConnection, this, std::placeholders::_1)
+        [this](const TcpConnectionPtr &c) { removeConnection(c); }
     );
+    conn->setMigrateCallback(
+        [this](const TcpConnectionPtr &c, EventLoop *newLoop) { connectionMigrating(c, newLoop); }
+    );
+    shardOf(ioLoop)->connections[conn->id()] = conn;
 
-    // 直接调用TcpConnection::connectEstablished
-    ioLoop->runInLoop(std::bind(&TcpConnection::connectEstablished, conn));
-
+    // 已经在ioLoop的线程里了，直接建立连接
+    conn->connectEstablished();
 }
 
 void TcpServer::removeConnection(const TcpConnectionPtr &conn)
 {
-    loop_->runInLoop(
-        std::bind(&TcpServer::removeConnectionInLoop, this, conn)
-    );
-}
+    LOG_DEBUG("TcpServer::removeConnection [%s] - connection %s\n", name_.c_str(), conn->name().c_str());
 
-void TcpServer::removeConnectionInLoop(const TcpConnectionPtr &conn)
-{
-    LOG_INFO("TcpServer::removeConnectionInLoop [%s] - connection %s\n", name_.c_str(), conn->name().c_str());
-
-    connections_.erase(conn->name());
     EventLoop *ioLoop = conn->getLoop();
+    ConnectionShard *shard = shardOf(ioLoop);
+    // 迁移到不属于这个服务器的loop上的连接，迁移时已经从连接表里删掉了
+    if (shard != nullptr)
+    {
+        shard->connections.erase(conn->id());
+        shard->trafficSamples.erase(conn->id());
+    }
+    // 正在处理这个连接的channel事件，销毁放到这一轮的回调里
     ioLoop->queueInLoop(
         std::bind(&TcpConnection::connectDestoryed, conn)
     );
 }
 
-
+void TcpServer::connectionMigrating(const TcpConnectionPtr &conn, EventLoop *newLoop)
+{
+    // 连接的loop_还没有切换，conn->getLoop()是旧loop
+    ConnectionShard *oldShard = shardOf(conn->getLoop());
+    if (oldShard != nullptr)
+    {
+        oldShard->connections.erase(conn->id());
+        oldShard->trafficSamples.erase(conn->id());
+    }
+    newLoop->queueInLoop([this, conn, newLoop]() {
+        ConnectionShard *shard = shardOf(newLoop);
+        if (shard != nullptr)
+        {
+            shard->connections[conn->id()] = conn;
+        }
+    });
+}
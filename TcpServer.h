@@ -14,6 +14,7 @@
 #include <string>
 #include <memory>
 #include <atomic>
+#include <vector>
 #include <unordered_map>
 
 // 对外的服务器编程使用的类
@@ -22,16 +23,28 @@ class TcpServer : noncopyable
 public:
     using ThreadInitCallback = std::function<void(EventLoop*)>;
 
+    /**
+     * 监听方式
+     * kNoReusePort/kReusePort: mainLoop上一个Acceptor，新连接再分配给subloop，区别只是监听socket是否设置SO_REUSEPORT
+     * kReusePortPerLoop: 每个subloop各自bind一个SO_REUSEPORT的监听socket，内核在它们之间分配新连接，
+     *                    连接在accept它的loop上建立，不经过mainLoop，负载均衡策略和SO_INCOMING_CPU分配都不生效
+     * kExclusiveListener: 所有subloop共享一个监听socket，用EPOLLEXCLUSIVE注册，一个新连接只唤醒一个loop，
+     *                     给不能用SO_REUSEPORT分流的场景用(需要epoll，io_uring poller下退化成全部唤醒)
+     * 没有subloop时后两种方式都在baseLoop上accept
+     */
     enum Option
     {
         kNoReusePort,
         kReusePort,
-    }; // 端口是否可重用
+        kReusePortPerLoop,
+        kExclusiveListener,
+    };
 
     TcpServer(EventLoop *loop,
                 const InetAddress &listenAddr,
                 const std::string &nameArg,
                 Option option = kNoReusePort);
+    // 必须在loop(baseLoop)的线程里析构，析构时等各个subloop销毁自己的连接，subloop要还在运行
     ~TcpServer();
 
     void setThreadInitcallback(const ThreadInitCallback &cb) { threadInitCallback_ = cb; }
@@ -43,24 +56,132 @@ public:
     // 设置底层subloop的个数
     void setThreadNum(int numThreads);
 
+    /**
+     * 管理接口：运行时把subloop调整到numThreads个，可以在任意线程调用，在baseLoop里执行
+     * 增加的loop马上开始接收新连接；减少时最后加入的loop退役，不再分配新连接，
+     * migrateConnections为true时把它们的连接迁移到剩下的loop上(完成模式的连接不能迁移，等它们自己关闭)，
+     * 否则等连接自己关闭；退役loop的连接都没了以后线程退出
+     * 每个loop一个Acceptor的方式下，退役loop的监听socket关闭时还在它队列里的连接会被内核重置
+     * 需要在start之后调用
+     */
+    void resizeThreadPool(int numThreads, bool migrateConnections = true);
+    // 正在分配新连接的subloop个数 / 退役了还没退出的subloop个数，只能在baseLoop线程里调用
+    int numThreads() const { return threadPool_->numThreads(); }
+    size_t numRetiringLoops() const { return threadPool_->getRetiredLoops().size(); }
+
+    // subloop使用忙轮询模式，见EventLoop::setBusyPoll，需要在start之前设置
+    void setBusyPoll(int spinUs, int socketBusyPollUs = 0) { threadPool_->setBusyPoll(spinUs, socketBusyPollUs); }
+    // subloop绑核，见EventLoopThreadPool::setCpuAffinity，需要在start之前设置
+    void setCpuAffinity(const std::vector<int> &cpus) { threadPool_->setCpuAffinity(cpus); }
+    void setCpuAffinityPerPhysicalCore() { threadPool_->setCpuAffinityPerPhysicalCore(); }
+    // 新连接按SO_INCOMING_CPU交给绑定在同一个cpu(或者同一个NUMA节点)上的subloop，
+    // 需要同时设置绑核，找不到合适的loop时还是轮询
+    void setIncomingCpuSteering(bool on) { incomingCpuSteering_ = on; }
+
+    // 新连接分配给subloop的策略，见EventLoopThreadPool::LoadBalancePolicy，需要在start之前设置
+    void setLoadBalancePolicy(EventLoopThreadPool::LoadBalancePolicy policy) { threadPool_->setLoadBalancePolicy(policy); }
+    void setLoopChooser(const EventLoopThreadPool::LoopChooser &chooser) { threadPool_->setLoopChooser(chooser); }
+
+    // subloop延迟提交channel的事件修改，见EventLoop::setDeferredChannelUpdates，需要在start之前设置
+    void setDeferredChannelUpdates(bool on) { threadPool_->setDeferredChannelUpdates(on); }
+
+    // 新连接使用io_uring完成模式读写(需要MUDUO_USE_IOURING)，见TcpConnection::setCompletionIo
+    void setCompletionIo(bool on) { completionIo_ = on; }
+
+    // 新连接使用边沿触发模式，见TcpConnection::setEdgeTriggered
+    void setEdgeTriggered(bool on, size_t budget = TcpConnection::kDefaultEventByteBudget)
+    {
+        edgeTriggered_ = on;
+        eventByteBudget_ = budget;
+    }
+
+    // 每次监听socket可读时最多accept的连接数，见Acceptor::setAcceptBatch，需要在start之前设置
+    void setAcceptBatch(int batch);
+    // 所有Acceptor累计accept的连接数 / fd用完时直接关闭的连接数，可以在任意线程读
+    uint64_t numAccepted() const;
+    uint64_t numDropped() const;
+
+    // 连接空闲超时，单位秒，<=0表示不启用；超时的连接在自己的subloop里被关闭
+    void setIdleTimeout(double seconds) { idleTimeout_ = seconds; }
+    // 新连接的输入缓冲区空闲多久以后缩小，见TcpConnection::setBufferShrinkIdle
+    void setBufferShrinkIdle(double seconds) { bufferShrinkIdle_ = seconds; }
+
+    /**
+     * 内存报告：每个loop的连接数、连接对象和缓冲区占用的内存、线程内存池缓存的内存，以及平均每个连接的内存
+     * 在每个loop的线程里统计，等全部统计完再返回，只能在baseLoop线程里调用
+     */
+    std::string memoryReport();
+
+    /**
+     * 自动重新均衡：每intervalSec秒在baseLoop里比较一次subloop的EventLoop::loadScore，
+     * 最忙的loop超过最闲的ratio倍时，把最忙loop上的连接迁移到最闲的loop(TcpConnection::migrateTo)
+     * 每轮最多迁移maxMoves个，只挑负载不超过两个loop差距一半的连接，避免来回迁移
+     * 需要在start之前设置
+     */
+    void enableRebalancer(double intervalSec, double ratio = 1.5, int maxMoves = 1);
+    // 自动迁移过的连接数
+    uint64_t numMigrations() const { return numMigrations_.load(std::memory_order_relaxed); }
+
     // 开启服务器监听
     void start();
 
+    // 在每个loop的线程里对它的连接依次调用cb，异步执行；需要在start之后调用
+    void forEachConnection(const std::function<void(const TcpConnectionPtr&)> &cb);
+    // 给所有连接发送message
+    void broadcast(const std::string &message);
+
 
 private:
+    // mainLoop的Acceptor的回调，选一个subloop再建立连接
     void newConnection(int sockfd, const InetAddress &peerAddr);
+    // 在ioLoop的线程里建立连接：mainLoop只把fd和对端地址交过来，TcpConnection在subloop里构造
+    void createConnection(EventLoop *ioLoop, int sockfd, const InetAddress &peerAddr);
+    // 每个loop一个Acceptor的方式，让Acceptor和当前分配新连接的loop一一对应，start和调整loop个数时调用
+    void updateLoopAcceptors();
+    void stopLoopAcceptors();
+    // 连接关闭时在连接所属的loop里调用，从这个loop的连接表里删掉，不经过mainLoop
     void removeConnection(const TcpConnectionPtr &conn);
-    void removeConnectionInLoop(const TcpConnectionPtr &conn);
-
-
-    using ConnectionMap = std::unordered_map<std::string, TcpConnectionPtr>;
+    // 迁移开始时在旧loop里调用，把连接从旧loop的连接表挪到新loop的连接表
+    void connectionMigrating(const TcpConnectionPtr &conn, EventLoop *newLoop);
+    void resizeThreadPoolInLoop(int numThreads, bool migrateConnections);
+    // 在退役的loop里把它的连接轮流迁移到targets上
+    void drainLoop(EventLoop *retired, const std::vector<EventLoop*> &targets);
+    // baseLoop的定时器回调，回收连接都没了的退役loop
+    void checkRetiredLoops();
+    // baseLoop、分配新连接的subloop和退役的subloop，只能在baseLoop线程里调用
+    std::vector<EventLoop*> serverLoops() const;
+    // 定时器回调，在baseLoop里执行，挑连接的工作交给最忙的loop自己做
+    void rebalance();
+    void rebalanceInLoop(EventLoop *hot, EventLoop *cold, int64_t gap);
+
+    using ConnectionMap = std::unordered_map<uint64_t, TcpConnectionPtr>; // 按TcpConnection::id索引
+
+    // 一个loop的连接表，挂在loop上(EventLoop::setContext，key是this)，只在这个loop的线程里访问
+    // loop可以在运行时增减，连接表不放在TcpServer里，其它loop查找时不需要加锁
+    struct ConnectionShard
+    {
+        ConnectionMap connections;
+        std::unordered_map<uint64_t, uint64_t> trafficSamples; // 上一次重新均衡时每个连接的bytesTransferred
+        Timestamp lastSample;
+    };
+    // 只能在loop线程里调用，loop不属于这个服务器时返回nullptr
+    ConnectionShard* shardOf(EventLoop *loop) const;
+    // 给loop建连接表，投递到loop线程里执行，排在之后投递给这个loop的新连接前面
+    void createShard(EventLoop *loop);
     
     EventLoop *loop_;  // baseLoop 用户定义的loop
 
     const std::string ipPort_;
     const std::string name_;
+    const std::shared_ptr<const std::string> connNamePrefix_; // name_-ipPort_，所有连接共享
+    const InetAddress listenAddr_;
+    const Option option_;
     
-    std::unique_ptr<Acceptor> acceptor_; // 运行在mainLoop，任务就是监听新连接事件
+    std::unique_ptr<Acceptor> acceptor_; // 运行在mainLoop，任务就是监听新连接事件，每个loop自己accept时为空
+    std::vector<std::unique_ptr<Acceptor>> loopAcceptors_; // 每个loop一个，各自在自己的loop上析构
+    // 每个Acceptor accept/丢弃一个连接就加一，读的时候不用碰可能正在增删的loopAcceptors_
+    std::atomic<uint64_t> numAccepted_;
+    std::atomic<uint64_t> numDropped_;
 
     std::shared_ptr<EventLoopThreadPool> threadPool_;  // one loop per thread
 
@@ -72,7 +193,23 @@ private:
     ThreadInitCallback threadInitCallback_; // loop线程初始化的回调
     std::atomic_int started_;
 
-    int nextConnId_;
-    ConnectionMap connections_; //保持所有的连接
+    std::atomic<uint64_t> nextConnId_;
+
+    double idleTimeout_; // 新连接的空闲超时
+    double bufferShrinkIdle_;
+    bool completionIo_;
+    bool edgeTriggered_;
+    bool incomingCpuSteering_;
+    size_t eventByteBudget_;
+    int acceptBatch_;
+
+    double rebalanceInterval_;
+    double rebalanceRatio_;
+    int rebalanceMaxMoves_;
+    TimerId rebalanceTimer_;
+    std::atomic<uint64_t> numMigrations_;
+
+    bool drainMigrates_;   // 退役loop上的连接是否迁走
+    TimerId retireTimer_;  // 有退役loop时每kRetireCheckInterval秒检查一次
 
 };
\ No newline at end of file
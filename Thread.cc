@@ -1,5 +1,6 @@
 #include "Thread.h"
 #include "CurrentThread.h"
+#include "CpuAffinity.h"
 
 #include <semaphore.h>
 
@@ -46,6 +47,7 @@ void Thread::start()  // 一个thread对象，记录的就是一个新线程的
     thread_ = std::shared_ptr<std::thread>(new std::thread([&](){
         // 获取线程的tid值
         tid_ = CurrentThread::tid();
+        CpuAffinity::setCurrentThreadName(name_); // top/perf里能看到线程名
         sem_post(&sem);
         // 开启一个新线程，专门执行该线程函数
         func_();
@@ -0,0 +1,257 @@
+#include "ThreadPool.h"
+#include "EventLoop.h"
+#include "TcpConnection.h"
+#include "Logger.h"
+
+// 当前线程所属的线程池和它在池里的下标，工作线程里提交的任务直接放进自己的队列
+__thread ThreadPool *t_pool = nullptr;
+__thread size_t t_workerIndex = 0;
+
+namespace
+{
+
+class ReadLockGuard : noncopyable
+{
+public:
+    explicit ReadLockGuard(pthread_rwlock_t *lock) : lock_(lock) { ::pthread_rwlock_rdlock(lock_); }
+    ~ReadLockGuard() { ::pthread_rwlock_unlock(lock_); }
+private:
+    pthread_rwlock_t *lock_;
+};
+
+class WriteLockGuard : noncopyable
+{
+public:
+    explicit WriteLockGuard(pthread_rwlock_t *lock) : lock_(lock) { ::pthread_rwlock_wrlock(lock_); }
+    ~WriteLockGuard() { ::pthread_rwlock_unlock(lock_); }
+private:
+    pthread_rwlock_t *lock_;
+};
+
+} // namespace
+
+ThreadPool::ThreadPool(const std::string &name)
+    : name_(name)
+    , running_(false)
+    , nextWorker_(0)
+    , pending_(0)
+    , sleepers_(0)
+    , numExecuted_(0)
+    , numStolen_(0)
+{
+    ::pthread_rwlock_init(&workersLock_, nullptr);
+}
+
+ThreadPool::~ThreadPool()
+{
+    if (t_pool == this)
+    {
+        // 工作线程还在跑，池析构以后它们访问的都是释放掉的内存，没有能安全继续的办法
+        LOG_FATAL("ThreadPool %s destroyed in its own task \n", name_.c_str());
+    }
+    stop();
+    ::pthread_rwlock_destroy(&workersLock_);
+}
+
+void ThreadPool::start(int numThreads)
+{
+    WriteLockGuard guard(&workersLock_);
+    if (running_)
+    {
+        LOG_ERROR("ThreadPool %s already started \n", name_.c_str());
+        return;
+    }
+    workers_.clear();
+    running_ = true;
+    for (int i = 0; i < numThreads; ++i)
+    {
+        std::unique_ptr<Worker> worker(new Worker);
+        worker->randomState = 2463534242u + i * 7919u;
+        workers_.push_back(std::move(worker));
+    }
+    // 所有队列都建好以后再启动线程，偷取的时候会访问其它线程的队列
+    for (size_t i = 0; i < workers_.size(); ++i)
+    {
+        workers_[i]->thread.reset(new Thread(std::bind(&ThreadPool::workerFunc, this, i),
+            name_ + std::to_string(i)));
+        workers_[i]->thread->start();
+    }
+}
+
+void ThreadPool::stop()
+{
+    // 在任务里stop要join当前线程自己，join会抛resource_deadlock_would_occur
+    if (t_pool == this)
+    {
+        LOG_ERROR("ThreadPool %s stop() called in its own task, ignored \n", name_.c_str());
+        return;
+    }
+    // 拿到写锁以后running_才变成false，之后别的线程的run都会看到停止，不会再往队列里放任务
+    WriteLockGuard guard(&workersLock_);
+    if (!running_)
+    {
+        return;
+    }
+    {
+        std::lock_guard<std::mutex> lock(sleepMutex_);
+        running_ = false;
+    }
+    sleepCond_.notify_all();
+    // 工作线程不碰workersLock_，持锁join不会死锁
+    for (auto &worker : workers_)
+    {
+        worker->thread->join();
+    }
+    workers_.clear();
+}
+
+int ThreadPool::numThreads() const
+{
+    ReadLockGuard guard(&workersLock_);
+    return static_cast<int>(workers_.size());
+}
+
+void ThreadPool::run(Task task)
+{
+    // 工作线程里提交的任务放进自己的队列，不用加锁：stop要等工作线程都退出才会清空workers_
+    if (t_pool == this)
+    {
+        enqueue(t_workerIndex, std::move(task));
+        return;
+    }
+
+    bool runInline = false;
+    {
+        ReadLockGuard guard(&workersLock_);
+        if (!running_)
+        {
+            LOG_ERROR("ThreadPool %s is not running, task dropped \n", name_.c_str());
+            return;
+        }
+        runInline = workers_.empty();
+        if (!runInline)
+        {
+            size_t index = nextWorker_.fetch_add(1, std::memory_order_relaxed) % workers_.size();
+            enqueue(index, std::move(task));
+        }
+    }
+    // start(0)，在锁外执行，任务里调stop也不会死锁
+    if (runInline)
+    {
+        task();
+    }
+}
+
+void ThreadPool::enqueue(size_t index, Task task)
+{
+    Worker *worker = workers_[index].get();
+    {
+        std::lock_guard<std::mutex> lock(worker->mutex);
+        worker->tasks.push_back(std::move(task));
+    }
+
+    // 先增加pending_再看有没有线程在睡，和workerFunc里的顺序相反，两边至少有一边能看到对方
+    pending_.fetch_add(1);
+    if (sleepers_.load() > 0)
+    {
+        std::lock_guard<std::mutex> lock(sleepMutex_);
+        sleepCond_.notify_one();
+    }
+}
+
+void ThreadPool::submit(const TcpConnectionPtr &conn, Task task, Continuation continuation)
+{
+    // 工作线程只持有weak_ptr，任务排队和执行期间不延长连接的生命期；连接已经销毁时continuation不再执行
+    std::weak_ptr<TcpConnection> weakConn(conn);
+    run([weakConn, task, continuation]() {
+        task();
+        TcpConnectionPtr guard(weakConn.lock());
+        if (guard)
+        {
+            guard->queueInLoop(std::bind(continuation, guard));
+        }
+    });
+}
+
+void ThreadPool::submit(EventLoop *loop, Task task, Task continuation)
+{
+    run([loop, task, continuation]() {
+        task();
+        loop->queueInLoop(continuation);
+    });
+}
+
+void ThreadPool::workerFunc(size_t index)
+{
+    t_pool = this;
+    t_workerIndex = index;
+
+    for (;;)
+    {
+        Task task;
+        if (popLocal(index, &task) || steal(index, &task))
+        {
+            pending_.fetch_sub(1);
+            task();
+            numExecuted_.fetch_add(1, std::memory_order_relaxed);
+            continue;
+        }
+
+        std::unique_lock<std::mutex> lock(sleepMutex_);
+        if (!running_ && pending_.load() <= 0)
+        {
+            break; // 停止之前提交的任务都执行完了
+        }
+        sleepers_.fetch_add(1);
+        sleepCond_.wait(lock, [this]() { return pending_.load() > 0 || !running_; });
+        sleepers_.fetch_sub(1);
+    }
+
+    t_pool = nullptr;
+}
+
+bool ThreadPool::popLocal(size_t index, Task *task)
+{
+    Worker *worker = workers_[index].get();
+    std::lock_guard<std::mutex> lock(worker->mutex);
+    if (worker->tasks.empty())
+    {
+        return false;
+    }
+    *task = std::move(worker->tasks.back());
+    worker->tasks.pop_back();
+    return true;
+}
+
+bool ThreadPool::steal(size_t thief, Task *task)
+{
+    size_t n = workers_.size();
+    if (n < 2)
+    {
+        return false;
+    }
+
+    uint32_t &x = workers_[thief]->randomState;
+    x ^= x << 13;
+    x ^= x >> 17;
+    x ^= x << 5;
+    size_t start = x % n;
+    for (size_t i = 0; i < n; ++i)
+    {
+        size_t victim = (start + i) % n;
+        if (victim == thief)
+        {
+            continue;
+        }
+        Worker *worker = workers_[victim].get();
+        std::lock_guard<std::mutex> lock(worker->mutex);
+        if (!worker->tasks.empty())
+        {
+            *task = std::move(worker->tasks.front());
+            worker->tasks.pop_front();
+            numStolen_.fetch_add(1, std::memory_order_relaxed);
+            return true;
+        }
+    }
+    return false;
+}
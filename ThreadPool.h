@@ -0,0 +1,89 @@
+#pragma once
+
+#include "noncopyable.h"
+#include "Thread.h"
+#include "Callbacks.h"
+
+#include <functional>
+#include <deque>
+#include <vector>
+#include <mutex>
+#include <condition_variable>
+#include <atomic>
+#include <memory>
+#include <string>
+#include <pthread.h>
+
+class EventLoop;
+
+/**
+ * 计算线程池，给onMessage里CPU密集的工作(压缩、JSON、加解密)用，不阻塞IO loop
+ *
+ * 每个工作线程一个双端队列：自己从尾部取(后进先出，数据还在缓存里)，自己的空了就随机挑一个线程从头部偷
+ * 其它线程提交的任务轮流放进各个工作线程的队列，工作线程里提交的任务放进自己的队列
+ *
+ * submit的continuation在任务完成以后投递回loop执行，连接的状态仍然只在它自己的loop里访问：
+ *   pool.submit(conn, [req]() { compress(req); }, [req](const TcpConnectionPtr &c) { c->send(req->out); });
+ * 结果通过两个回调共同持有的对象(比如shared_ptr)传递
+ */
+class ThreadPool : noncopyable
+{
+public:
+    using Task = std::function<void()>;
+    using Continuation = std::function<void(const TcpConnectionPtr&)>;
+
+    explicit ThreadPool(const std::string &name = std::string("ThreadPool"));
+    ~ThreadPool();
+
+    // 启动numThreads个工作线程，numThreads为0时任务直接在提交的线程里执行
+    void start(int numThreads);
+    // 已经提交的任务执行完以后线程退出，之后再提交的任务被丢弃并记错误日志
+    // 不能在这个池自己的任务里调用(要join执行任务的线程自己)，这时记错误日志直接返回；析构同样不能在池自己的任务里进行
+    void stop();
+
+    // 可以在任意线程调用，和stop并发也安全
+    void run(Task task);
+    // task在工作线程里执行，完成以后continuation投递到conn当前所属的loop(连接迁移过也没关系)
+    // 池里只保存conn的weak_ptr，task完成时连接已经销毁就不执行continuation
+    void submit(const TcpConnectionPtr &conn, Task task, Continuation continuation);
+    // task在工作线程里执行，完成以后continuation投递到loop
+    void submit(EventLoop *loop, Task task, Task continuation);
+
+    const std::string& name() const { return name_; }
+    int numThreads() const;
+    // 执行过的任务数 / 其中从别的线程偷来的任务数
+    uint64_t numExecuted() const { return numExecuted_.load(std::memory_order_relaxed); }
+    uint64_t numStolen() const { return numStolen_.load(std::memory_order_relaxed); }
+
+private:
+    struct Worker
+    {
+        std::mutex mutex;
+        std::deque<Task> tasks;
+        uint32_t randomState;   // 挑选偷取对象用的xorshift状态，只有这个线程自己用
+        std::unique_ptr<Thread> thread;
+    };
+
+    void workerFunc(size_t index);
+    // 调用者保证workers_在这期间不会被清空
+    void enqueue(size_t index, Task task);
+    bool popLocal(size_t index, Task *task);
+    bool steal(size_t thief, Task *task);
+
+    std::string name_;
+    // run在任意线程读workers_，start/stop改workers_和running_时加写锁
+    // c++11没有shared_mutex，用pthread的读写锁
+    mutable pthread_rwlock_t workersLock_;
+    std::vector<std::unique_ptr<Worker>> workers_;
+    std::atomic_bool running_;
+    std::atomic<uint32_t> nextWorker_;
+
+    // 已经放进队列还没被取走的任务数，和sleepers_一起决定要不要唤醒空闲线程
+    std::atomic<int64_t> pending_;
+    std::atomic_int sleepers_;
+    std::mutex sleepMutex_;
+    std::condition_variable sleepCond_;
+
+    std::atomic<uint64_t> numExecuted_;
+    std::atomic<uint64_t> numStolen_;
+};
@@ -0,0 +1,45 @@
+#pragma once
+
+#include "noncopyable.h"
+#include "Timestamp.h"
+#include "Callbacks.h"
+
+#include <atomic>
+
+// 定时器，记录回调、到期时间以及重复间隔
+class Timer : noncopyable
+{
+public:
+    Timer(TimerCallback cb, Timestamp when, double interval)
+        : callback_(std::move(cb))
+        , expiration_(when)
+        , interval_(interval)
+        , repeat_(interval > 0.0)
+        , sequence_(++s_numCreated_)
+        , heapIndex_(-1)
+    {}
+
+    void run() const { callback_(); }
+
+    Timestamp expiration() const { return expiration_; }
+    bool repeat() const { return repeat_; }
+    int64_t sequence() const { return sequence_; }
+
+    // 重复定时器到期以后原地修改到期时间，不需要重新new一个Timer
+    void restart(Timestamp now);
+
+    static int64_t numCreated() { return s_numCreated_; }
+
+private:
+    friend class TimerQueue;
+
+    const TimerCallback callback_;
+    Timestamp expiration_;
+    const double interval_;  // 重复间隔，单位秒，<=0表示只执行一次
+    const bool repeat_;
+    const int64_t sequence_; // 全局唯一的序号，TimerId靠它识别定时器
+
+    int heapIndex_;          // 在TimerQueue小根堆中的下标，-1表示不在堆中
+
+    static std::atomic<int64_t> s_numCreated_;
+};
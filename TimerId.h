@@ -0,0 +1,18 @@
+#pragma once
+
+#include <stdint.h>
+
+// 对外暴露的定时器标识，用于EventLoop::cancel
+// 只记录序号，Timer对象被释放以后持有的TimerId依然可以安全地cancel
+class TimerId
+{
+public:
+    TimerId() : sequence_(0) {}
+    explicit TimerId(int64_t seq) : sequence_(seq) {}
+
+    int64_t sequence() const { return sequence_; }
+    bool valid() const { return sequence_ > 0; }
+
+private:
+    int64_t sequence_;
+};
@@ -0,0 +1,263 @@
+#include "TimerQueue.h"
+#include "Timer.h"
+#include "EventLoop.h"
+#include "Logger.h"
+
+#include <sys/timerfd.h>
+#include <unistd.h>
+#include <errno.h>
+#include <string.h>
+
+static int createTimerfd()
+{
+    int timerfd = ::timerfd_create(CLOCK_MONOTONIC, TFD_NONBLOCK | TFD_CLOEXEC);
+    if (timerfd < 0)
+    {
+        LOG_FATAL("timerfd_create error:%d \n", errno);
+    }
+    return timerfd;
+}
+
+TimerQueue::TimerQueue(EventLoop *loop)
+    : loop_(loop)
+    , timerfd_(createTimerfd())
+    , timerfdChannel_(loop, timerfd_)
+    , callingExpiredTimers_(false)
+{
+    timerfdChannel_.setReadCallback(std::bind(&TimerQueue::handleRead, this));
+    // timerfd到期以后发生读事件，和其它channel一样由poller上报
+    timerfdChannel_.enableReading();
+}
+
+TimerQueue::~TimerQueue()
+{
+    timerfdChannel_.disableAll();
+    timerfdChannel_.remove();
+    ::close(timerfd_);
+    for (Timer *timer : heap_)
+    {
+        delete timer;
+    }
+}
+
+TimerId TimerQueue::addTimer(TimerCallback cb, Timestamp when, double interval)
+{
+    Timer *timer = new Timer(std::move(cb), when, interval);
+    loop_->runInLoop(std::bind(&TimerQueue::addTimerInLoop, this, timer));
+    return TimerId(timer->sequence());
+}
+
+void TimerQueue::cancel(TimerId timerId)
+{
+    loop_->runInLoop(std::bind(&TimerQueue::cancelInLoop, this, timerId));
+}
+
+int TimerQueue::nextTimeoutMs(int defaultMs) const
+{
+    if (heap_.empty())
+    {
+        return defaultMs;
+    }
+    int64_t micro = heap_.front()->expiration().microSecondsSinceEpoch()
+                    - Timestamp::now().microSecondsSinceEpoch();
+    if (micro <= 0)
+    {
+        return 0;
+    }
+    int64_t ms = (micro + 999) / 1000; // 向上取整，避免提前醒来空转一次
+    return ms < defaultMs ? static_cast<int>(ms) : defaultMs;
+}
+
+void TimerQueue::addTimerInLoop(Timer *timer)
+{
+    activeTimers_[timer->sequence()] = timer;
+    heapPush(timer);
+    // 新定时器成了最早到期的那个，需要重新设置timerfd
+    if (timer->heapIndex_ == 0)
+    {
+        resetTimerfd();
+    }
+}
+
+void TimerQueue::cancelInLoop(TimerId timerId)
+{
+    auto it = activeTimers_.find(timerId.sequence());
+    if (it == activeTimers_.end())
+    {
+        return; // 已经执行完或者已经取消了
+    }
+
+    Timer *timer = it->second;
+    if (timer->heapIndex_ >= 0)
+    {
+        bool wasFirst = timer->heapIndex_ == 0;
+        heapErase(timer);
+        activeTimers_.erase(it);
+        delete timer;
+        if (wasFirst)
+        {
+            resetTimerfd();
+        }
+    }
+    else if (callingExpiredTimers_)
+    {
+        // 定时器已经到期，正在expired_里面等待执行或者正在执行自己的回调
+        // 记录下来，不执行、不重启，回调结束后统一释放
+        cancelingTimers_.insert(timerId.sequence());
+    }
+}
+
+void TimerQueue::handleRead()
+{
+    uint64_t howmany = 0;
+    ssize_t n = ::read(timerfd_, &howmany, sizeof howmany);
+    if (n != sizeof howmany)
+    {
+        LOG_ERROR("TimerQueue::handleRead() reads %ld bytes instead of 8 \n", n);
+    }
+
+    Timestamp now(Timestamp::now());
+
+    // 把所有到期的定时器从堆中取出来
+    expired_.clear();
+    while (!heap_.empty() && !(now < heap_.front()->expiration()))
+    {
+        Timer *timer = heap_.front();
+        heapErase(timer);
+        expired_.push_back(timer);
+    }
+
+    callingExpiredTimers_ = true;
+    cancelingTimers_.clear();
+    for (Timer *timer : expired_)
+    {
+        if (cancelingTimers_.empty() || cancelingTimers_.count(timer->sequence()) == 0)
+        {
+            timer->run();
+        }
+    }
+    callingExpiredTimers_ = false;
+
+    // 重复定时器原地修改到期时间重新入堆，其余的释放掉
+    for (Timer *timer : expired_)
+    {
+        if (timer->repeat() && cancelingTimers_.count(timer->sequence()) == 0)
+        {
+            timer->restart(now);
+            heapPush(timer);
+        }
+        else
+        {
+            activeTimers_.erase(timer->sequence());
+            delete timer;
+        }
+    }
+    expired_.clear();
+
+    resetTimerfd();
+}
+
+void TimerQueue::resetTimerfd()
+{
+    struct itimerspec newValue;
+    ::memset(&newValue, 0, sizeof newValue);
+
+    if (!heap_.empty())
+    {
+        int64_t micro = heap_.front()->expiration().microSecondsSinceEpoch()
+                        - Timestamp::now().microSecondsSinceEpoch();
+        // it_value全0表示关闭timerfd，所以最少也要设置1微秒
+        if (micro < 1)
+        {
+            micro = 1;
+        }
+        newValue.it_value.tv_sec = static_cast<time_t>(micro / Timestamp::kMicroSecondsPerSecond);
+        newValue.it_value.tv_nsec = static_cast<long>((micro % Timestamp::kMicroSecondsPerSecond) * 1000);
+    }
+
+    if (::timerfd_settime(timerfd_, 0, &newValue, nullptr) < 0)
+    {
+        LOG_ERROR("timerfd_settime error:%d \n", errno);
+    }
+}
+
+// 到期时间相同的按创建顺序排列
+bool TimerQueue::earlier(const Timer *lhs, const Timer *rhs) const
+{
+    if (lhs->expiration() == rhs->expiration())
+    {
+        return lhs->sequence() < rhs->sequence();
+    }
+    return lhs->expiration() < rhs->expiration();
+}
+
+void TimerQueue::heapPush(Timer *timer)
+{
+    timer->heapIndex_ = static_cast<int>(heap_.size());
+    heap_.push_back(timer);
+    siftUp(heap_.size() - 1);
+}
+
+void TimerQueue::heapErase(Timer *timer)
+{
+    size_t index = static_cast<size_t>(timer->heapIndex_);
+    size_t last = heap_.size() - 1;
+    if (index != last)
+    {
+        heapSwap(index, last);
+    }
+    heap_.pop_back();
+    timer->heapIndex_ = -1;
+
+    if (index < heap_.size())
+    {
+        siftUp(index);
+        siftDown(index);
+    }
+}
+
+void TimerQueue::siftUp(size_t index)
+{
+    while (index > 0)
+    {
+        size_t parent = (index - 1) / 2;
+        if (!earlier(heap_[index], heap_[parent]))
+        {
+            break;
+        }
+        heapSwap(index, parent);
+        index = parent;
+    }
+}
+
+void TimerQueue::siftDown(size_t index)
+{
+    size_t size = heap_.size();
+    while (true)
+    {
+        size_t smallest = index;
+        size_t left = index * 2 + 1;
+        size_t right = left + 1;
+        if (left < size && earlier(heap_[left], heap_[smallest]))
+        {
+            smallest = left;
+        }
+        if (right < size && earlier(heap_[right], heap_[smallest]))
+        {
+            smallest = right;
+        }
+        if (smallest == index)
+        {
+            break;
+        }
+        heapSwap(index, smallest);
+        index = smallest;
+    }
+}
+
+void TimerQueue::heapSwap(size_t i, size_t j)
+{
+    std::swap(heap_[i], heap_[j]);
+    heap_[i]->heapIndex_ = static_cast<int>(i);
+    heap_[j]->heapIndex_ = static_cast<int>(j);
+}
@@ -0,0 +1,63 @@
+#pragma once
+
+#include "noncopyable.h"
+#include "Timestamp.h"
+#include "Channel.h"
+#include "Callbacks.h"
+#include "TimerId.h"
+
+#include <vector>
+#include <unordered_map>
+#include <unordered_set>
+
+class EventLoop;
+class Timer;
+
+/**
+ * 定时器队列，每个EventLoop拥有一个
+ * 所有定时器共用一个timerfd，timerfd打包成channel注册到loop的poller上，
+ * timerfd的到期时间始终设置为最早到期的那个定时器
+ * 定时器按到期时间组织成小根堆，Timer记录自己在堆中的下标，添加和取消都是O(log n)
+ */
+class TimerQueue : noncopyable
+{
+public:
+    explicit TimerQueue(EventLoop *loop);
+    ~TimerQueue();
+
+    // 线程安全，可以在其它线程调用
+    TimerId addTimer(TimerCallback cb, Timestamp when, double interval);
+    void cancel(TimerId timerId);
+
+    // 距离最早到期的定时器还有多少毫秒，没有定时器时返回defaultMs，结果不会超过defaultMs
+    // 只能在loop线程调用
+    int nextTimeoutMs(int defaultMs) const;
+
+private:
+    void addTimerInLoop(Timer *timer);
+    void cancelInLoop(TimerId timerId);
+
+    // timerfd可读，执行所有到期的定时器
+    void handleRead();
+    // 根据堆顶重新设置timerfd的到期时间
+    void resetTimerfd();
+
+    // 小根堆的操作
+    bool earlier(const Timer *lhs, const Timer *rhs) const;
+    void heapPush(Timer *timer);
+    void heapErase(Timer *timer);
+    void siftUp(size_t index);
+    void siftDown(size_t index);
+    void heapSwap(size_t i, size_t j);
+
+    EventLoop *loop_;
+    const int timerfd_;
+    Channel timerfdChannel_;
+
+    std::vector<Timer*> heap_;                        // 按到期时间排序的小根堆
+    std::unordered_map<int64_t, Timer*> activeTimers_;// sequence => Timer，cancel时判断定时器是否还存在
+
+    bool callingExpiredTimers_;                       // 是否正在执行到期定时器的回调
+    std::unordered_set<int64_t> cancelingTimers_;     // 回调执行期间被取消的定时器
+    std::vector<Timer*> expired_;                     // 复用的到期定时器列表，避免每次到期都分配内存
+};
@@ -0,0 +1,129 @@
+#include "TimingWheel.h"
+#include "EventLoop.h"
+
+#include <math.h>
+
+TimingWheel::Entry::Entry()
+    : prev_(this)
+    , next_(this)
+    , wheel_(nullptr)
+    , expireTick_(0)
+{
+}
+
+TimingWheel::Entry::~Entry()
+{
+    if (wheel_)
+    {
+        wheel_->remove(this);
+    }
+}
+
+void TimingWheel::Entry::unlink()
+{
+    prev_->next_ = next_;
+    next_->prev_ = prev_;
+    prev_ = next_ = this;
+}
+
+TimingWheel::TimingWheel(EventLoop *loop, double tickSeconds, size_t numBuckets)
+    : loop_(loop)
+    , tickSeconds_(tickSeconds)
+    , currentTick_(0)
+    , size_(0)
+    , buckets_(numBuckets)
+{
+    tickTimer_ = loop_->runEvery(tickSeconds_, std::bind(&TimingWheel::onTick, this));
+}
+
+TimingWheel::~TimingWheel()
+{
+    loop_->cancel(tickTimer_);
+    // 还挂着的entry属于仍然存活的对象，断开它们和时间轮的关系，避免析构时访问已释放的时间轮
+    for (Entry &head : buckets_)
+    {
+        while (head.next_ != &head)
+        {
+            Entry *entry = head.next_;
+            entry->unlink();
+            entry->wheel_ = nullptr;
+        }
+    }
+}
+
+void TimingWheel::touch(Entry *entry, double timeout)
+{
+    // 当前这一格已经走了一部分，多加一格保证不会提前到期，实际超时落在[timeout, timeout+tick)
+    int64_t ticks = static_cast<int64_t>(::ceil(timeout / tickSeconds_));
+    int64_t expireTick = currentTick_ + (ticks < 1 ? 1 : ticks) + 1;
+
+    if (entry->wheel_ == this && entry->expireTick_ == expireTick)
+    {
+        return; // 同一个tick内的重复刷新
+    }
+    if (entry->wheel_)
+    {
+        entry->wheel_->remove(entry);
+    }
+
+    entry->expireTick_ = expireTick;
+    entry->wheel_ = this;
+    linkBefore(&buckets_[expireTick % buckets_.size()], entry);
+    ++size_;
+}
+
+void TimingWheel::remove(Entry *entry)
+{
+    if (entry->wheel_ == this)
+    {
+        entry->unlink();
+        entry->wheel_ = nullptr;
+        --size_;
+    }
+}
+
+void TimingWheel::onTick()
+{
+    ++currentTick_;
+    Entry &head = buckets_[currentTick_ % buckets_.size()];
+    if (head.next_ == &head)
+    {
+        return;
+    }
+
+    // 先把整个桶摘到局部链表上，回调里可能会摘除/刷新其它entry
+    Entry pending;
+    pending.next_ = head.next_;
+    pending.prev_ = head.prev_;
+    pending.next_->prev_ = &pending;
+    pending.prev_->next_ = &pending;
+    head.next_ = head.prev_ = &head;
+
+    while (pending.next_ != &pending)
+    {
+        Entry *entry = pending.next_;
+        entry->unlink();
+        if (entry->expireTick_ <= currentTick_)
+        {
+            entry->wheel_ = nullptr;
+            --size_;
+            if (entry->callback_)
+            {
+                entry->callback_();
+            }
+        }
+        else
+        {
+            // 还要再转几圈，放回原来的桶
+            linkBefore(&head, entry);
+        }
+    }
+}
+
+void TimingWheel::linkBefore(Entry *pos, Entry *entry)
+{
+    entry->next_ = pos;
+    entry->prev_ = pos->prev_;
+    pos->prev_->next_ = entry;
+    pos->prev_ = entry;
+}
@@ -0,0 +1,68 @@
+#pragma once
+
+#include "noncopyable.h"
+#include "TimerId.h"
+
+#include <functional>
+#include <vector>
+#include <stdint.h>
+#include <stddef.h>
+
+class EventLoop;
+
+/**
+ * 哈希时间轮，每个EventLoop一个，给大量连接做空闲/读/写超时
+ * 每个桶是一个侵入式双向链表，Entry嵌在使用者(TcpConnection)里面，
+ * 刷新超时只是把Entry从一个桶摘下来挂到另一个桶上，O(1)且不分配内存；
+ * 同一个tick内重复刷新到同一个桶直接返回
+ * 超时时间超过一圈的Entry记录绝对的到期tick，转到它所在的桶时没到期就留在原地
+ * 时间轮只能在所属loop的线程里使用
+ */
+class TimingWheel : noncopyable
+{
+public:
+    class Entry : noncopyable
+    {
+    public:
+        using ExpireCallback = std::function<void()>;
+
+        Entry();
+        ~Entry(); // 析构时自动从时间轮上摘除
+
+        void setCallback(ExpireCallback cb) { callback_ = std::move(cb); }
+        bool linked() const { return wheel_ != nullptr; }
+
+    private:
+        friend class TimingWheel;
+
+        void unlink();
+
+        Entry *prev_;
+        Entry *next_;
+        TimingWheel *wheel_;  // 当前挂在哪个时间轮上，nullptr表示没有挂上
+        int64_t expireTick_;  // 到期的绝对tick
+        ExpireCallback callback_;
+    };
+
+    TimingWheel(EventLoop *loop, double tickSeconds, size_t numBuckets);
+    ~TimingWheel();
+
+    // entry在timeout秒以后到期，已经挂在时间轮上的话就是刷新到期时间
+    void touch(Entry *entry, double timeout);
+    // 把entry从时间轮上摘下来，不会再触发回调
+    void remove(Entry *entry);
+
+    double tickSeconds() const { return tickSeconds_; }
+    size_t size() const { return size_; }
+
+private:
+    void onTick();
+    static void linkBefore(Entry *pos, Entry *entry);
+
+    EventLoop *loop_;
+    const double tickSeconds_;
+    int64_t currentTick_;
+    size_t size_;                // 挂在时间轮上的entry数量
+    std::vector<Entry> buckets_; // 每个桶的哨兵节点
+    TimerId tickTimer_;
+};
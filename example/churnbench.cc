@@ -0,0 +1,128 @@
+#include <mymuduo/TcpServer.h>
+#include <mymuduo/EventLoop.h>
+#include <mymuduo/Thread.h>
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/time.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+#include <vector>
+#include <memory>
+#include <atomic>
+#include <new>
+
+// 短连接压测：客户端不停地建连接，服务器在连接回调里直接shutdown，客户端读到EOF以后关闭再建下一个
+// 测的是每秒能完成多少次accept到连接建立再到关闭的完整过程，以及平均每个连接的内存分配次数
+// 用法: ./churnbench [端口] [subloop数] [客户端线程数] [秒数] [reuseport]
+
+// 替换全局的operator new统计分配次数，libmymuduo.so里的分配也会走到这里
+static std::atomic<int64_t> g_allocations(0);
+
+void* operator new(size_t size)
+{
+    g_allocations.fetch_add(1, std::memory_order_relaxed);
+    void *p = ::malloc(size);
+    if (p == nullptr)
+    {
+        throw std::bad_alloc();
+    }
+    return p;
+}
+
+void operator delete(void *p) noexcept
+{
+    ::free(p);
+}
+
+void operator delete(void *p, size_t) noexcept
+{
+    ::free(p);
+}
+
+static double nowSeconds()
+{
+    struct timeval tv;
+    gettimeofday(&tv, NULL);
+    return tv.tv_sec + tv.tv_usec / 1000000.0;
+}
+
+static void runClient(uint16_t port, double deadline, std::atomic<int64_t> *cycles)
+{
+    sockaddr_in addr;
+    memset(&addr, 0, sizeof addr);
+    addr.sin_family = AF_INET;
+    addr.sin_port = htons(port);
+    addr.sin_addr.s_addr = inet_addr("127.0.0.1");
+
+    char buf[16];
+    while (nowSeconds() < deadline)
+    {
+        int fd = ::socket(AF_INET, SOCK_STREAM, 0);
+        if (::connect(fd, (sockaddr*)&addr, sizeof addr) == 0)
+        {
+            while (::read(fd, buf, sizeof buf) > 0)
+            {
+            }
+            ++*cycles;
+        }
+        ::close(fd);
+    }
+}
+
+int main(int argc, char *argv[])
+{
+    uint16_t port = static_cast<uint16_t>(argc > 1 ? atoi(argv[1]) : 9991);
+    int numThreads = argc > 2 ? atoi(argv[2]) : 2;
+    int numClients = argc > 3 ? atoi(argv[3]) : 4;
+    double seconds = argc > 4 ? atof(argv[4]) : 3.0;
+    bool reusePort = argc > 5 && strcmp(argv[5], "reuseport") == 0;
+
+    EventLoop loop;
+    TcpServer server(&loop, InetAddress(port), "churnbench",
+        reusePort ? TcpServer::kReusePortPerLoop : TcpServer::kNoReusePort);
+    server.setThreadNum(numThreads);
+    server.setConnectionCallback([](const TcpConnectionPtr &conn) {
+        if (conn->connected())
+        {
+            conn->shutdown();
+        }
+    });
+    server.setMessageCallback([](const TcpConnectionPtr&, Buffer *buf, Timestamp) { buf->retrieveAll(); });
+    server.start();
+
+    std::atomic<int64_t> cycles(0);
+    double elapsed = 0;
+    int64_t allocations = 0;
+    Thread clients([&]() {
+        int64_t allocationsBefore = g_allocations.load();
+        double start = nowSeconds();
+        double deadline = start + seconds;
+        std::vector<std::unique_ptr<Thread>> threads;
+        for (int i = 0; i < numClients; ++i)
+        {
+            threads.emplace_back(new Thread([port, deadline, &cycles]() { runClient(port, deadline, &cycles); }));
+            threads.back()->start();
+        }
+        for (auto &t : threads)
+        {
+            t->join();
+        }
+        elapsed = nowSeconds() - start;
+        allocations = g_allocations.load() - allocationsBefore;
+        loop.quit();
+    });
+    clients.start();
+    loop.loop();
+    clients.join();
+
+    printf("listen=%s subloops=%d clients=%d time=%.3fs accepted=%lu dropped=%lu cycles=%ld (%.0f accepts/s) allocs/conn=%.2f\n",
+        reusePort ? "reuseport" : "single", numThreads, numClients, elapsed,
+        static_cast<unsigned long>(server.numAccepted()), static_cast<unsigned long>(server.numDropped()),
+        static_cast<long>(cycles.load()), server.numAccepted() / elapsed,
+        static_cast<double>(allocations) / static_cast<double>(cycles.load() > 0 ? cycles.load() : 1));
+    return 0;
+}
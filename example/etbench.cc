@@ -0,0 +1,125 @@
+#include <mymuduo/TcpServer.h>
+#include <mymuduo/EventLoop.h>
+#include <mymuduo/Thread.h>
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/time.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+#include <string>
+#include <vector>
+#include <memory>
+#include <atomic>
+
+// 大块数据的echo，比较水平触发(lt)和边沿触发(et)的吞吐量和消息回调次数
+// 用法: ./etbench lt|et [端口] [连接数] [每个连接发送的MB数]
+
+static double nowSeconds()
+{
+    struct timeval tv;
+    gettimeofday(&tv, NULL);
+    return tv.tv_sec + tv.tv_usec / 1000000.0;
+}
+
+static int connectTo(uint16_t port)
+{
+    int fd = ::socket(AF_INET, SOCK_STREAM, 0);
+    sockaddr_in addr;
+    memset(&addr, 0, sizeof addr);
+    addr.sin_family = AF_INET;
+    addr.sin_port = htons(port);
+    addr.sin_addr.s_addr = inet_addr("127.0.0.1");
+    if (::connect(fd, (sockaddr*)&addr, sizeof addr) < 0)
+    {
+        perror("connect");
+        exit(1);
+    }
+    return fd;
+}
+
+// 一个线程发，当前线程收，收齐了返回
+static void runClient(uint16_t port, size_t totalBytes)
+{
+    int fd = connectTo(port);
+    Thread writer([fd, totalBytes]() {
+        std::string chunk(1024 * 1024, 'x');
+        size_t sent = 0;
+        while (sent < totalBytes)
+        {
+            size_t len = std::min(chunk.size(), totalBytes - sent);
+            ssize_t n = ::write(fd, chunk.data(), len);
+            if (n <= 0)
+            {
+                break;
+            }
+            sent += n;
+        }
+    });
+    writer.start();
+
+    std::vector<char> buf(1024 * 1024);
+    size_t received = 0;
+    while (received < totalBytes)
+    {
+        ssize_t n = ::read(fd, buf.data(), buf.size());
+        if (n <= 0)
+        {
+            break;
+        }
+        received += n;
+    }
+    writer.join();
+    ::close(fd);
+}
+
+int main(int argc, char *argv[])
+{
+    bool edgeTriggered = argc > 1 && strcmp(argv[1], "et") == 0;
+    uint16_t port = static_cast<uint16_t>(argc > 2 ? atoi(argv[2]) : 9990);
+    int numConnections = argc > 3 ? atoi(argv[3]) : 4;
+    size_t totalBytes = static_cast<size_t>(argc > 4 ? atoi(argv[4]) : 256) * 1024 * 1024;
+
+    EventLoop loop;
+    TcpServer server(&loop, InetAddress(port), "etbench");
+    server.setThreadNum(1);
+    server.setEdgeTriggered(edgeTriggered);
+
+    std::atomic<int64_t> messages(0);
+    server.setConnectionCallback([](const TcpConnectionPtr&) {});
+    server.setMessageCallback([&messages](const TcpConnectionPtr &conn, Buffer *buf, Timestamp) {
+        ++messages;
+        conn->send(buf->peekView());
+        buf->retrieveAll();
+    });
+    server.start();
+
+    double elapsed = 0;
+    Thread clients([&]() {
+        double start = nowSeconds();
+        std::vector<std::unique_ptr<Thread>> threads;
+        for (int i = 0; i < numConnections; ++i)
+        {
+            threads.emplace_back(new Thread([port, totalBytes]() { runClient(port, totalBytes); }));
+            threads.back()->start();
+        }
+        for (auto &t : threads)
+        {
+            t->join();
+        }
+        elapsed = nowSeconds() - start;
+        loop.quit();
+    });
+    clients.start();
+    loop.loop();
+    clients.join();
+
+    double mb = static_cast<double>(totalBytes) * numConnections / (1024 * 1024);
+    printf("mode=%s connections=%d total=%.0fMB time=%.3fs throughput=%.1fMB/s messages=%ld (%.1f per MB)\n",
+        edgeTriggered ? "et" : "lt", numConnections, mb, elapsed, mb / elapsed,
+        static_cast<long>(messages.load()), messages.load() / mb);
+    return 0;
+}
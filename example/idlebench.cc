@@ -0,0 +1,121 @@
+#include <mymuduo/TcpServer.h>
+#include <mymuduo/EventLoop.h>
+#include <mymuduo/Thread.h>
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+#include <vector>
+#include <string>
+
+// 空闲连接的内存压测：客户端建好N个连接，每个连接发一个请求以后就不动了
+// 请求以换行结尾，服务器处理完整的行；90%的连接发完整的请求，9%发半行，1%发300KB不带换行的大请求
+// 依次打印：连接建好以后、缓冲区空闲缩小以后的内存报告和进程RSS
+// 用法: ./idlebench [端口] [连接数] [subloop数] [缓冲区空闲缩小秒数]
+
+static long residentKB()
+{
+    long pages = 0;
+    long resident = 0;
+    FILE *fp = ::fopen("/proc/self/statm", "r");
+    if (fp != nullptr)
+    {
+        if (::fscanf(fp, "%ld %ld", &pages, &resident) != 2)
+        {
+            resident = 0;
+        }
+        ::fclose(fp);
+    }
+    return resident * (::sysconf(_SC_PAGESIZE) / 1024);
+}
+
+static void openClients(uint16_t port, int numConnections, std::vector<int> *fds)
+{
+    sockaddr_in addr;
+    memset(&addr, 0, sizeof addr);
+    addr.sin_family = AF_INET;
+    addr.sin_port = htons(port);
+    addr.sin_addr.s_addr = inet_addr("127.0.0.1");
+
+    std::string complete(63, 'c');
+    complete += '\n';
+    std::string partial(64, 'p');
+    std::string large(300 * 1024, 'l');
+    for (int i = 0; i < numConnections; ++i)
+    {
+        int fd = ::socket(AF_INET, SOCK_STREAM, 0);
+        if (::connect(fd, (sockaddr*)&addr, sizeof addr) != 0)
+        {
+            ::close(fd);
+            break;
+        }
+        const std::string &request = i % 100 == 0 ? large : (i % 10 == 1 ? partial : complete);
+        size_t sent = 0;
+        while (sent < request.size())
+        {
+            ssize_t n = ::write(fd, request.data() + sent, request.size() - sent);
+            if (n <= 0)
+            {
+                break;
+            }
+            sent += n;
+        }
+        fds->push_back(fd);
+    }
+}
+
+int main(int argc, char *argv[])
+{
+    uint16_t port = static_cast<uint16_t>(argc > 1 ? atoi(argv[1]) : 9992);
+    int numConnections = argc > 2 ? atoi(argv[2]) : 5000;
+    int numThreads = argc > 3 ? atoi(argv[3]) : 2;
+    double shrinkIdle = argc > 4 ? atof(argv[4]) : 1.0;
+
+    EventLoop loop;
+    TcpServer server(&loop, InetAddress(port), "idlebench");
+    server.setThreadNum(numThreads);
+    server.setBufferShrinkIdle(shrinkIdle);
+    server.setConnectionCallback([](const TcpConnectionPtr&) {});
+    server.setMessageCallback([](const TcpConnectionPtr&, Buffer *buf, Timestamp) {
+        const char *eol = buf->findEOL();
+        while (eol != nullptr)
+        {
+            buf->retrieveUntil(eol + 1);
+            eol = buf->findEOL();
+        }
+    });
+    server.start();
+
+    long baseKB = residentKB();
+    std::vector<int> fds;
+    auto report = [&](const char *stage) {
+        long rssKB = residentKB();
+        printf("== %s: rss %ldKB, %.0f bytes/connection over baseline (client sockets included)\n%s",
+            stage, rssKB, fds.empty() ? 0.0 : (rssKB - baseKB) * 1024.0 / fds.size(),
+            server.memoryReport().c_str());
+        fflush(stdout);
+    };
+
+    // 客户端建完连接以后回到baseLoop，等数据都读进输入缓冲区再打印报告
+    Thread clients([&]() {
+        openClients(port, numConnections, &fds);
+        loop.runAfter(0.5, [&]() { report("connected"); });
+        loop.runAfter(shrinkIdle + 1.5, [&]() {
+            report("after idle shrink");
+            loop.quit();
+        });
+    });
+    clients.start();
+    loop.loop();
+    clients.join();
+
+    for (int fd : fds)
+    {
+        ::close(fd);
+    }
+    return 0;
+}
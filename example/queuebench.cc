@@ -0,0 +1,76 @@
+#include <mymuduo/EventLoop.h>
+#include <mymuduo/EventLoopThread.h>
+#include <mymuduo/Thread.h>
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <sys/time.h>
+#include <vector>
+#include <memory>
+#include <atomic>
+
+// 多个生产者线程同时往同一个loop里queueInLoop，测量每秒能投递并执行多少个回调
+// 用法: ./queuebench [生产者线程数] [每个线程投递的回调数]
+
+static double nowSeconds()
+{
+    struct timeval tv;
+    gettimeofday(&tv, NULL);
+    return tv.tv_sec + tv.tv_usec / 1000000.0;
+}
+
+int main(int argc, char *argv[])
+{
+    int numProducers = argc > 1 ? atoi(argv[1]) : 4;
+    int perProducer = argc > 2 ? atoi(argv[2]) : 1000000;
+    const int64_t total = static_cast<int64_t>(numProducers) * perProducer;
+
+    EventLoopThread loopThread;
+    EventLoop *loop = loopThread.startLoop();
+
+    int64_t executed = 0;  // 只在loop线程里修改
+    std::atomic_bool done(false);
+    std::atomic_int ready(0);
+    std::atomic_bool go(false);
+
+    std::vector<std::unique_ptr<Thread>> producers;
+    for (int i = 0; i < numProducers; ++i)
+    {
+        producers.emplace_back(new Thread([&]() {
+            ++ready;
+            while (!go) {}
+            for (int j = 0; j < perProducer; ++j)
+            {
+                loop->queueInLoop([&]() {
+                    if (++executed == total)
+                    {
+                        done = true;
+                    }
+                });
+            }
+        }));
+        producers.back()->start();
+    }
+
+    while (ready < numProducers) {}
+    double start = nowSeconds();
+    go = true;
+    for (auto &t : producers)
+    {
+        t->join();
+    }
+    double enqueued = nowSeconds();
+    while (!done)
+    {
+        ::usleep(100);
+    }
+    double finished = nowSeconds();
+
+    printf("producers=%d functors=%ld enqueue=%.3fs (%.0f/s) executed=%.3fs (%.0f/s)\n",
+        numProducers, total,
+        enqueued - start, total / (enqueued - start),
+        finished - start, total / (finished - start));
+    printf("wakeups issued=%lu suppressed=%lu\n",
+        loop->wakeupsIssued(), loop->wakeupsSuppressed());
+    return 0;
+}
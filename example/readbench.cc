@@ -0,0 +1,97 @@
+#include <mymuduo/Buffer.h>
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/time.h>
+#include <sys/socket.h>
+#include <string>
+#include <algorithm>
+
+// Buffer::readFd的微基准：往socketpair里写定长的消息，每写一片(最多64KB)就readFd读一次，收齐一条消息就retrieve
+// 每种消息大小打印读的次数、平均每次读到的字节数、经过暂存区的字节数、在存储之间搬运的字节数(以及占读到的字节数的比例)和每次读的耗时
+// 用法: ./readbench [每种消息大小发送的MB数]
+
+static double nowSeconds()
+{
+    struct timeval tv;
+    gettimeofday(&tv, NULL);
+    return tv.tv_sec + tv.tv_usec / 1000000.0;
+}
+
+static void runCase(size_t messageSize, size_t totalBytes)
+{
+    int fds[2];
+    if (::socketpair(AF_UNIX, SOCK_STREAM, 0, fds) != 0)
+    {
+        perror("socketpair");
+        exit(1);
+    }
+
+    // 每条消息按kSliceSize切片写，每写一片就读一次，模拟一片一片到达的大消息
+    const size_t kSliceSize = 64 * 1024;
+    size_t numMessages = totalBytes / messageSize;
+    std::string message(messageSize, 'm');
+    Buffer buffer;
+    Buffer::Stats before = Buffer::stats();
+    double start = nowSeconds();
+    size_t received = 0;
+    for (size_t i = 0; i < numMessages; ++i)
+    {
+        for (size_t sent = 0; sent < messageSize; )
+        {
+            size_t len = std::min(kSliceSize, messageSize - sent);
+            if (::write(fds[1], message.data() + sent, len) != static_cast<ssize_t>(len))
+            {
+                perror("write");
+                exit(1);
+            }
+            sent += len;
+
+            int savedErrno = 0;
+            if (buffer.readFd(fds[0], &savedErrno) <= 0)
+            {
+                perror("readFd");
+                exit(1);
+            }
+            while (buffer.readableBytes() >= messageSize)
+            {
+                buffer.retrieve(messageSize);
+                received += messageSize;
+            }
+        }
+    }
+    double seconds = nowSeconds() - start;
+    Buffer::Stats after = Buffer::stats();
+
+    uint64_t reads = after.reads - before.reads;
+    double perRead = reads == 0 ? 0.0 : 1.0 / reads;
+    uint64_t bytesRead = after.bytesRead - before.bytesRead;
+    uint64_t bytesCopied = after.bytesCopied - before.bytesCopied;
+    printf("%8zu %8lu %12.0f %12.0f %12.0f %8.1f%% %10.0f %8.1f%s\n",
+        messageSize, (unsigned long)reads,
+        bytesRead * perRead,
+        (after.bytesSpilled - before.bytesSpilled) * perRead,
+        bytesCopied * perRead,
+        bytesRead == 0 ? 0.0 : bytesCopied * 100.0 / bytesRead,
+        seconds * 1e9 * perRead,
+        received / seconds / 1024 / 1024,
+        received == numMessages * messageSize ? "" : " (short)");
+
+    ::close(fds[0]);
+    ::close(fds[1]);
+}
+
+int main(int argc, char *argv[])
+{
+    size_t totalMB = argc > 1 ? atoi(argv[1]) : 256;
+    printf("%8s %8s %12s %12s %12s %9s %10s %8s\n",
+        "msgsize", "reads", "bytes/read", "spilled/read", "copied/read", "copied", "ns/read", "MB/s");
+    const size_t sizes[] = { 64, 1024, 16 * 1024, 64 * 1024, 256 * 1024, 1024 * 1024 };
+    for (size_t size : sizes)
+    {
+        runCase(size, totalMB * 1024 * 1024);
+    }
+    return 0;
+}
@@ -50,8 +50,9 @@ void onMessage(const TcpConnectionPtr &conn,
             Buffer *buf,
             Timestamp time)
 {
-    std::string msg = buf->retrieveAllAsString();
-    conn->send(msg);
+    // 直接发送缓冲区里的数据，不拷成std::string
+    conn->send(buf->peekView());
+    buf->retrieveAll();
     conn->shutdown(); // 关闭写端 EPOLLHUP =》 closeCallback_
 }
 